@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define LSM_HAVE_SSE42_CRC32C
+#endif
+
+constexpr std::array<uint32_t, 256> makeCrc32cTable() {
+    // reversed Castagnoli polynomial
+    constexpr uint32_t kPolynomial = 0x82F63B78;
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? kPolynomial : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint32_t, 256> kCrc32cTable = makeCrc32cTable();
+
+// CRC32C (Castagnoli), computed with the SSE4.2 crc32 instruction when the cpu has it
+class Crc32c {
+private:
+    static uint32_t extendPortable(uint32_t crc, const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            crc = kCrc32cTable[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#ifdef LSM_HAVE_SSE42_CRC32C
+    __attribute__((target("sse4.2")))
+    static uint32_t extendSse42(uint32_t crc, const char* data, size_t size) {
+        uint64_t crc64 = crc;
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; size > 0; data++, size--) {
+            crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+        }
+        return crc;
+    }
+
+    static bool hasSse42() {
+        static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+        return has_sse42;
+    }
+#endif
+
+public:
+    // the crc of the concatenation of the data crc was computed from and data
+    static uint32_t extend(uint32_t crc, const char* data, size_t size) {
+        crc = ~crc;
+#ifdef LSM_HAVE_SSE42_CRC32C
+        if (hasSse42()) {
+            return ~extendSse42(crc, data, size);
+        }
+#endif
+        return ~extendPortable(crc, data, size);
+    }
+
+    static uint32_t value(const char* data, size_t size) {
+        return extend(0, data, size);
+    }
+
+    static uint32_t value(const std::string& data) {
+        return value(data.data(), data.size());
+    }
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef LSM_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef LSM_HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+// codec of an sstable block, stored in the block trailer
+enum class CompressionType : uint8_t {
+    NONE = 0,
+    LZ4 = 1,
+    ZSTD = 2,
+};
+
+// A zstd dictionary shared by all blocks of an sstable, digested once for compression
+// and decompression. Without zstd it is only kept as bytes.
+class CompressionDict {
+private:
+    std::string data;
+#ifdef LSM_HAVE_ZSTD
+    ZSTD_CDict* cdict{nullptr};
+    ZSTD_DDict* ddict{nullptr};
+#endif
+public:
+    static constexpr int kZstdLevel = 3;
+
+    explicit CompressionDict(std::string data_): data(std::move(data_)) {
+#ifdef LSM_HAVE_ZSTD
+        cdict = ZSTD_createCDict(data.data(), data.size(), kZstdLevel);
+        ddict = ZSTD_createDDict(data.data(), data.size());
+#endif
+    }
+
+    CompressionDict(const CompressionDict&) = delete;
+    CompressionDict& operator=(const CompressionDict&) = delete;
+
+    ~CompressionDict() {
+#ifdef LSM_HAVE_ZSTD
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+#endif
+    }
+
+    const std::string& get_data() const {
+        return data;
+    }
+
+#ifdef LSM_HAVE_ZSTD
+    const ZSTD_CDict* get_cdict() const {
+        return cdict;
+    }
+
+    const ZSTD_DDict* get_ddict() const {
+        return ddict;
+    }
+#endif
+
+    // train a dictionary of at most max_dict_bytes from samples, the concatenation of samples
+    // of sample_sizes bytes. Returns an empty string if zstd is missing or training fails
+    static std::string train([[maybe_unused]] const std::string& samples, [[maybe_unused]] const std::vector<size_t>& sample_sizes,
+        [[maybe_unused]] size_t max_dict_bytes) {
+#ifdef LSM_HAVE_ZSTD
+        std::string dict(max_dict_bytes, '\0');
+        size_t dict_size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sample_sizes.data(), sample_sizes.size());
+        if (ZDICT_isError(dict_size)) {
+            return "";
+        }
+        dict.resize(dict_size);
+        return dict;
+#else
+        return "";
+#endif
+    }
+};
+
+class Compression {
+private:
+#ifdef LSM_HAVE_ZSTD
+    // contexts are reused by all blocks compressed or uncompressed by a thread
+    static ZSTD_CCtx* getZstdCCtx() {
+        thread_local std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        return cctx.get();
+    }
+
+    static ZSTD_DCtx* getZstdDCtx() {
+        thread_local std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        return dctx.get();
+    }
+#endif
+public:
+    static constexpr int kZstdLevel = CompressionDict::kZstdLevel;
+
+    // whether the codec was compiled in
+    static bool isSupported(CompressionType type) {
+        switch (type) {
+            case CompressionType::NONE:
+                return true;
+#ifdef LSM_HAVE_LZ4
+            case CompressionType::LZ4:
+                return true;
+#endif
+#ifdef LSM_HAVE_ZSTD
+            case CompressionType::ZSTD:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    // compress data to output, dict is only used by zstd.
+    // Returns false if the codec is not supported or fails
+    static bool compress(CompressionType type, [[maybe_unused]] const char* data, [[maybe_unused]] size_t size,
+        [[maybe_unused]] std::string& output, [[maybe_unused]] const CompressionDict* dict = nullptr) {
+        switch (type) {
+#ifdef LSM_HAVE_LZ4
+            case CompressionType::LZ4: {
+                output.resize(LZ4_compressBound(size));
+                int compressed_size = LZ4_compress_default(data, output.data(), size, output.size());
+                if (compressed_size <= 0) {
+                    return false;
+                }
+                output.resize(compressed_size);
+                return true;
+            }
+#endif
+#ifdef LSM_HAVE_ZSTD
+            case CompressionType::ZSTD: {
+                output.resize(ZSTD_compressBound(size));
+                size_t compressed_size = dict != nullptr && dict->get_cdict() != nullptr ?
+                    ZSTD_compress_usingCDict(getZstdCCtx(), output.data(), output.size(), data, size, dict->get_cdict()) :
+                    ZSTD_compressCCtx(getZstdCCtx(), output.data(), output.size(), data, size, kZstdLevel);
+                if (ZSTD_isError(compressed_size)) {
+                    return false;
+                }
+                output.resize(compressed_size);
+                return true;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    // uncompress data to output, uncompressed_size must be known by the caller,
+    // dict must be the one the data was compressed with
+    static bool uncompress(CompressionType type, const char* data, size_t size, size_t uncompressed_size, std::string& output,
+        [[maybe_unused]] const CompressionDict* dict = nullptr) {
+        output.resize(uncompressed_size);
+        switch (type) {
+            case CompressionType::NONE:
+                if (size != uncompressed_size) {
+                    return false;
+                }
+                output.assign(data, size);
+                return true;
+#ifdef LSM_HAVE_LZ4
+            case CompressionType::LZ4:
+                return LZ4_decompress_safe(data, output.data(), size, uncompressed_size) == static_cast<int>(uncompressed_size);
+#endif
+#ifdef LSM_HAVE_ZSTD
+            case CompressionType::ZSTD:
+                return (dict != nullptr && dict->get_ddict() != nullptr ?
+                    ZSTD_decompress_usingDDict(getZstdDCtx(), output.data(), uncompressed_size, data, size, dict->get_ddict()) :
+                    ZSTD_decompressDCtx(getZstdDCtx(), output.data(), uncompressed_size, data, size)) == uncompressed_size;
+#endif
+            default:
+                return false;
+        }
+    }
+};
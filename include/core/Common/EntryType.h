@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// kind of an entry, kept with it in the memtable and as the first byte of every entry in the data blocks
+enum class EntryType : uint8_t {
+    // the serialized value follows
+    VALUE = 0,
+    // the value is in a blob file, its BlobIndex follows
+    BLOB_INDEX = 1,
+    // the key is deleted, nothing follows
+    DELETION = 2,
+    // the serialized operand of merges follows, it applies to the older value of the key
+    MERGE = 3,
+    // a value that expires, see ExpiringValue
+    EXPIRING_VALUE = 4,
+};
+
+// payload of an EXPIRING_VALUE entry: [expire time (u64, ms since the epoch)][serialized value],
+// the key reads as deleted from the expire time on
+struct ExpiringValue {
+    static constexpr size_t kExpireTimeSize = sizeof(uint64_t);
+
+    static void putExpireTime(char* dst, uint64_t expire_time) {
+        memcpy(dst, &expire_time, kExpireTimeSize);
+    }
+
+    static uint64_t getExpireTime(std::string_view payload) {
+        uint64_t expire_time = 0;
+        if (payload.size() >= kExpireTimeSize) {
+            memcpy(&expire_time, payload.data(), kExpireTimeSize);
+        }
+        return expire_time;
+    }
+
+    static std::string_view getValue(std::string_view payload) {
+        return payload.size() >= kExpireTimeSize ? payload.substr(kExpireTimeSize) : std::string_view();
+    }
+
+    static std::string encode(uint64_t expire_time, std::string_view value_str) {
+        std::string payload(kExpireTimeSize, '\0');
+        putExpireTime(payload.data(), expire_time);
+        payload.append(value_str);
+        return payload;
+    }
+};
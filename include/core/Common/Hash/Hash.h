@@ -2,6 +2,7 @@
 #include "MurmurHash3.h"
 #include <vector>
 #include <memory>
+#include <string>
 
 using std::vector;
 using std::shared_ptr;
@@ -21,4 +22,14 @@ struct MurmurHash3 {
         MurmurHash3_x64_128(static_cast<const void*>(&key), len, 0, res.data());
         return res;
     }
-};
\ No newline at end of file
+};
+
+// variable length keys hash their bytes, not the string object
+template<>
+struct MurmurHash3<std::string> {
+    static vector<uint32_t> hash(const std::string& key, const int len) {
+        vector<uint32_t> res(4);
+        MurmurHash3_x64_128(static_cast<const void*>(key.data()), len, 0, res.data());
+        return res;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "Varint.h"
+
+// How keys are laid out in sstables, blob files and their indexes. Specialize it to support another key type.
+// Keys are compared with operator< everywhere, the encodings below keep that order.
+template<typename KType, typename Enable = void>
+struct KeyCodec;
+
+// Fixed width integer keys, the fast path: they map to uint64_t in key order, the index stores
+// the difference to the key before, and the restart keys can be searched by the learned model
+// and the Eytzinger layout
+template<typename KType>
+struct KeyCodec<KType, std::enable_if_t<std::is_integral_v<KType>>> {
+    static constexpr bool kFixedWidth = true;
+
+    // signed keys have their sign bit flipped so negative keys order before positive ones
+    static uint64_t toOrdered(KType key) {
+        uint64_t value = static_cast<std::make_unsigned_t<KType>>(key);
+        if constexpr (std::is_signed_v<KType>) {
+            value ^= uint64_t(1) << (sizeof(KType) * 8 - 1);
+        }
+        return value;
+    }
+
+    static KType fromOrdered(uint64_t value) {
+        if constexpr (std::is_signed_v<KType>) {
+            value ^= uint64_t(1) << (sizeof(KType) * 8 - 1);
+        }
+        return static_cast<KType>(static_cast<std::make_unsigned_t<KType>>(value));
+    }
+
+    // bytes hashed by the bloom filter
+    static const char* data(const KType& key) {
+        return reinterpret_cast<const char*>(&key);
+    }
+
+    static size_t size(const KType& key) {
+        return sizeof(key);
+    }
+
+    static void put(std::string& dst, const KType& key) {
+        dst.append(data(key), sizeof(key));
+    }
+
+    // decode a key from [p, limit), returns the byte after it or nullptr if it is malformed
+    static const char* get(const char* p, const char* limit, KType& key) {
+        if (limit - p < static_cast<std::ptrdiff_t>(sizeof(key))) {
+            return nullptr;
+        }
+        memcpy(&key, p, sizeof(key));
+        return p + sizeof(key);
+    }
+
+    // index entries store the key in full at restart points (prev is null), else its delta to prev
+    static void putIndexKey(std::string& dst, const KType& key, const KType* prev) {
+        Varint::put(dst, prev == nullptr ? toOrdered(key) : toOrdered(key) - toOrdered(*prev));
+    }
+
+    // key holds the key before unless restart
+    static const char* getIndexKey(const char* p, const char* limit, bool restart, KType& key) {
+        uint64_t value;
+        p = Varint::get(p, limit, value);
+        if (p != nullptr) {
+            key = fromOrdered(restart ? value : toOrdered(key) + value);
+        }
+        return p;
+    }
+};
+
+// Variable length keys, compared bytewise. They are length prefixed, the index stores
+// only the suffix a key doesn't share with the key before
+template<>
+struct KeyCodec<std::string> {
+    static constexpr bool kFixedWidth = false;
+
+    static const char* data(const std::string& key) {
+        return key.data();
+    }
+
+    static size_t size(const std::string& key) {
+        return key.size();
+    }
+
+    static void put(std::string& dst, const std::string& key) {
+        Varint::put(dst, key.size());
+        dst.append(key);
+    }
+
+    static const char* get(const char* p, const char* limit, std::string& key) {
+        uint64_t length;
+        p = Varint::get(p, limit, length);
+        if (p == nullptr || static_cast<uint64_t>(limit - p) < length) {
+            return nullptr;
+        }
+        key.assign(p, length);
+        return p + length;
+    }
+
+    static void putIndexKey(std::string& dst, const std::string& key, const std::string* prev) {
+        size_t shared = 0;
+        if (prev != nullptr) {
+            size_t max_shared = std::min(key.size(), prev->size());
+            while (shared < max_shared && key[shared] == (*prev)[shared]) {
+                shared++;
+            }
+            Varint::put(dst, shared);
+        }
+        Varint::put(dst, key.size() - shared);
+        dst.append(key, shared);
+    }
+
+    static const char* getIndexKey(const char* p, const char* limit, bool restart, std::string& key) {
+        uint64_t shared = 0, non_shared;
+        if (!restart && (p = Varint::get(p, limit, shared)) == nullptr) {
+            return nullptr;
+        }
+        p = Varint::get(p, limit, non_shared);
+        if (p == nullptr || shared > key.size() || static_cast<uint64_t>(limit - p) < non_shared) {
+            return nullptr;
+        }
+        key.resize(shared);
+        key.append(p, non_shared);
+        return p + non_shared;
+    }
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// Deleted key ranges [begin, end) of a memtable or an sstable, each deleting the versions of its keys
+// older than its sequence number. Ranges are split into disjoint fragments holding the sequence
+// numbers of all ranges that cover them, so a lookup is one binary search.
+template<typename KType>
+class RangeTombstoneList {
+    public:
+        struct Fragment {
+            KType end;
+            // newest first
+            std::vector<uint64_t> sequences;
+        };
+    private:
+        // begin -> fragment
+        std::map<KType, Fragment> fragments;
+
+        // make at a fragment boundary if a fragment covers it
+        void split(const KType& at) {
+            auto iter = fragments.upper_bound(at);
+            if (iter == fragments.begin()) {
+                return;
+            }
+            --iter;
+            if (iter->first < at && at < iter->second.end) {
+                fragments.emplace_hint(std::next(iter), at, Fragment{iter->second.end, iter->second.sequences});
+                iter->second.end = at;
+            }
+        }
+    public:
+        void add(const KType& begin, const KType& end, uint64_t sequence) {
+            if (!(begin < end)) {
+                return;
+            }
+            split(begin);
+            split(end);
+            KType cursor = begin;
+            auto iter = fragments.lower_bound(begin);
+            while (cursor < end) {
+                if (iter != fragments.end() && !(cursor < iter->first)) {
+                    auto& sequences = iter->second.sequences;
+                    sequences.insert(std::upper_bound(sequences.begin(), sequences.end(), sequence, std::greater<uint64_t>()), sequence);
+                    cursor = iter->second.end;
+                    ++iter;
+                } else {
+                    // a gap between fragments
+                    KType gap_end = iter != fragments.end() && iter->first < end ? iter->first : end;
+                    fragments.emplace_hint(iter, cursor, Fragment{gap_end, {sequence}});
+                    cursor = gap_end;
+                }
+            }
+        }
+
+        // sequence numbers of the ranges covering key, newest first, nullptr if there are none
+        const std::vector<uint64_t>* getSequences(const KType& key) const {
+            auto iter = fragments.upper_bound(key);
+            if (iter == fragments.begin() || !(key < std::prev(iter)->second.end)) {
+                return nullptr;
+            }
+            return &std::prev(iter)->second.sequences;
+        }
+
+        // sequence number of the newest range covering key that is visible at snapshot, 0 if there is none
+        uint64_t getSequence(const KType& key, uint64_t snapshot) const {
+            const auto* sequences = getSequences(key);
+            if (sequences != nullptr) {
+                for (uint64_t sequence: *sequences) {
+                    if (sequence <= snapshot) {
+                        return sequence;
+                    }
+                }
+            }
+            return 0;
+        }
+
+        size_t size() const {
+            return fragments.size();
+        }
+
+        bool empty() const {
+            return fragments.empty();
+        }
+
+        // fragments in key order, as pairs of begin and fragment
+        auto begin() const {
+            return fragments.begin();
+        }
+
+        auto end() const {
+            return fragments.end();
+        }
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+enum class IOPriority {
+    // flushes, they free memtable memory writers may be waiting for
+    HIGH = 0,
+    // compactions
+    LOW = 1,
+};
+
+// Token bucket limiting background writes to rate_bytes_per_sec.
+// Tokens are refilled every refill_period_us, and pending HIGH priority
+// requests are always granted before LOW priority ones.
+class RateLimiter {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Request {
+            uint64_t bytes;
+            bool granted{false};
+        };
+
+        std::atomic<uint64_t> rate_bytes_per_sec;
+        uint64_t refill_period_us;
+        uint64_t refill_bytes_per_period;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        uint64_t available_bytes{0};
+        Clock::time_point next_refill_time;
+        // pending requests of each priority, in arrival order
+        std::deque<Request*> queues[2];
+        uint64_t total_bytes_through[2]{0, 0};
+
+        static uint64_t calculateRefillBytesPerPeriod(uint64_t rate_bytes_per_sec, uint64_t refill_period_us) {
+            return std::max<uint64_t>(rate_bytes_per_sec * refill_period_us / 1000000, 1);
+        }
+
+        // the request that is granted next
+        Request* front() {
+            for (auto& queue: queues) {
+                if (!queue.empty()) {
+                    return queue.front();
+                }
+            }
+            return nullptr;
+        }
+
+        // grant requests in priority order while there are enough bytes, mutex must be held
+        void grantRequests() {
+            if (Clock::now() >= next_refill_time) {
+                available_bytes = refill_bytes_per_period;
+                next_refill_time = Clock::now() + std::chrono::microseconds(refill_period_us);
+            }
+            bool granted = false;
+            for (int priority = 0; priority < 2; priority++) {
+                auto& queue = queues[priority];
+                // a request queued before the rate was lowered may exceed a whole refill
+                while (!queue.empty() && std::min(queue.front()->bytes, refill_bytes_per_period) <= available_bytes) {
+                    available_bytes -= std::min(queue.front()->bytes, refill_bytes_per_period);
+                    total_bytes_through[priority] += queue.front()->bytes;
+                    queue.front()->granted = true;
+                    queue.pop_front();
+                    granted = true;
+                }
+                if (!queue.empty()) {
+                    // lower priorities wait for this queue to drain
+                    break;
+                }
+            }
+            if (granted) {
+                cv.notify_all();
+            }
+        }
+
+    public:
+        explicit RateLimiter(uint64_t rate_bytes_per_sec_, uint64_t refill_period_us_ = 100 * 1000):
+            rate_bytes_per_sec(rate_bytes_per_sec_),
+            refill_period_us(refill_period_us_),
+            refill_bytes_per_period(calculateRefillBytesPerPeriod(rate_bytes_per_sec_, refill_period_us_)),
+            next_refill_time(Clock::now())
+        {}
+
+        void setBytesPerSecond(uint64_t rate_bytes_per_sec_) {
+            std::lock_guard guard(mutex);
+            rate_bytes_per_sec = rate_bytes_per_sec_;
+            refill_bytes_per_period = calculateRefillBytesPerPeriod(rate_bytes_per_sec, refill_period_us);
+        }
+
+        uint64_t getBytesPerSecond() const {
+            return rate_bytes_per_sec;
+        }
+
+        uint64_t getTotalBytesThrough(IOPriority priority) {
+            std::lock_guard guard(mutex);
+            return total_bytes_through[static_cast<int>(priority)];
+        }
+
+        // block until bytes may be written, requests larger than one refill
+        // are granted in pieces
+        void request(uint64_t bytes, IOPriority priority) {
+            std::unique_lock guard(mutex);
+            while (bytes > 0) {
+                Request request{std::min(bytes, refill_bytes_per_period)};
+                queues[static_cast<int>(priority)].push_back(&request);
+                grantRequests();
+                while (!request.granted) {
+                    if (front() == &request) {
+                        // the next request waits for the refill, the others for it
+                        cv.wait_until(guard, next_refill_time);
+                    } else {
+                        cv.wait(guard);
+                    }
+                    grantRequests();
+                }
+                bytes -= request.bytes;
+            }
+        }
+};
@@ -1,34 +1,148 @@
 #pragma once
+#include <span>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "Varint.h"
 
 using std::string;
 
+// How values are stored in sstables, picked at compile time:
+// integers are varints (zigzag encoded if signed), other trivially copyable types are copied
+// as their sizeof(T) bytes, std::string is stored as is. Specialize SerializeWrapper for other types,
+// with serialize_size, serialize_to, deserialize_from and kFixedSize (kSize if it is true).
+// serialize_to writes exactly serialize_size(obj) bytes to a buffer of at least that size,
+// deserialize_from reads a value from the bytes, both without allocating for the bytes.
+// try_deserialize_from does the same but returns false if the bytes are not exactly one serialized
+// value, like a truncated one. serialize and deserialize are the copying shorthands of them.
 template<typename T>
+inline constexpr bool kVarintSerialized = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+template<typename T, typename Enable = void>
 class SerializeWrapper {
+    static_assert(!std::is_same_v<T, T>, "no serialization for this type, specialize SerializeWrapper for it");
+};
+
+// serialize and deserialize of a specialization in terms of its serialize_to and deserialize_from
+template<typename T, typename Derived>
+class SerializeWrapperBase {
 public:
     static std::string serialize(const T &obj) {
-        return "";
+        std::string data(Derived::serialize_size(obj), '\0');
+        Derived::serialize_to(obj, data);
+        return data;
     }
 
     static T deserialize(const std::string &data) {
-        return T();
+        return Derived::deserialize_from(data);
+    }
+
+    // specializations that can't tell malformed bytes apart accept them all
+    static bool try_deserialize_from(std::string_view data, T &obj) {
+        obj = Derived::deserialize_from(data);
+        return true;
+    }
+};
+
+template<typename T>
+class SerializeWrapper<T, std::enable_if_t<kVarintSerialized<T>>>: public SerializeWrapperBase<T, SerializeWrapper<T>> {
+    using Unsigned = std::make_unsigned_t<T>;
+
+    static constexpr uint64_t encode(T obj) {
+        if constexpr (std::is_signed_v<T>) {
+            // small negative values get short varints too
+            int64_t value = obj;
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+        return static_cast<Unsigned>(obj);
+    }
+
+    static constexpr T decode(uint64_t value) {
+        if constexpr (std::is_signed_v<T>) {
+            value = (value >> 1) ^ (~(value & 1) + 1);
+        }
+        return static_cast<T>(static_cast<Unsigned>(value));
+    }
+public:
+    static constexpr bool kFixedSize = false;
+
+    static size_t serialize_to(const T &obj, std::span<char> dst) {
+        return Varint::put(dst.data(), encode(obj)) - dst.data();
+    }
+
+    static T deserialize_from(std::string_view data) {
+        uint64_t value = 0;
+        Varint::get(data.data(), data.data() + data.size(), value);
+        return decode(value);
+    }
+
+    static bool try_deserialize_from(std::string_view data, T &obj) {
+        uint64_t value = 0;
+        const char* end = Varint::get(data.data(), data.data() + data.size(), value);
+        // a longer varint than T holds is not one of its values either
+        if (end != data.data() + data.size() || data.size() != Varint::length(value) || encode(decode(value)) != value) {
+            return false;
+        }
+        obj = decode(value);
+        return true;
     }
 
     static uint64_t serialize_size(const T &obj) {
-        return 0;
+        return Varint::length(encode(obj));
+    }
+};
+
+template<typename T>
+class SerializeWrapper<T, std::enable_if_t<std::is_trivially_copyable_v<T> && !kVarintSerialized<T>>>:
+    public SerializeWrapperBase<T, SerializeWrapper<T>> {
+public:
+    static constexpr bool kFixedSize = true;
+    static constexpr uint64_t kSize = sizeof(T);
+
+    static size_t serialize_to(const T &obj, std::span<char> dst) {
+        memcpy(dst.data(), &obj, kSize);
+        return kSize;
+    }
+
+    static T deserialize_from(std::string_view data) {
+        T obj{};
+        if (data.size() == kSize) {
+            memcpy(&obj, data.data(), kSize);
+        }
+        return obj;
+    }
+
+    static bool try_deserialize_from(std::string_view data, T &obj) {
+        if (data.size() != kSize) {
+            return false;
+        }
+        memcpy(&obj, data.data(), kSize);
+        return true;
+    }
+
+    static constexpr uint64_t serialize_size(const T &) {
+        return kSize;
     }
 };
 
 template<>
-class SerializeWrapper<std::string> {
+class SerializeWrapper<std::string>: public SerializeWrapperBase<std::string, SerializeWrapper<std::string>> {
 public:
+    static constexpr bool kFixedSize = false;
+
     static std::string serialize(const std::string &obj) {
         return obj;
     }
 
-    static std::string deserialize(const std::string &data) {
-        return data;
+    static size_t serialize_to(const std::string &obj, std::span<char> dst) {
+        memcpy(dst.data(), obj.data(), obj.size());
+        return obj.size();
+    }
+
+    static std::string deserialize_from(std::string_view data) {
+        return std::string(data);
     }
 
     static uint64_t serialize_size(const std::string &obj) {
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// LEB128 variable length integers, 7 bits per byte, the high bit marks a following byte
+class Varint {
+public:
+    static constexpr size_t kMaxLength = 10;
+
+    static size_t length(uint64_t value) {
+        size_t length = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            length++;
+        }
+        return length;
+    }
+
+    static void put(std::string& dst, uint64_t value) {
+        while (value >= 0x80) {
+            dst.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        dst.push_back(static_cast<char>(value));
+    }
+
+    // write value at dst, which has room for length(value) bytes, returns the byte after it
+    static char* put(char* dst, uint64_t value) {
+        while (value >= 0x80) {
+            *dst++ = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        *dst++ = static_cast<char>(value);
+        return dst;
+    }
+
+    // decode a varint from [p, limit), returns the byte after it or nullptr if it is malformed
+    static const char* get(const char* p, const char* limit, uint64_t& value) {
+        value = 0;
+        for (uint32_t shift = 0; shift < 64 && p < limit; shift += 7) {
+            uint64_t byte = static_cast<uint8_t>(*p++);
+            value |= (byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+};
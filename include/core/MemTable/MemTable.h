@@ -5,55 +5,126 @@
 #include <random>
 #include <vector>
 #include "SkipList.h"
-#include "DeleteMarker.h"
+#include "EntryType.h"
+#include "RangeTombstoneList.h"
 
 using std::vector;
 using std::unique_ptr;
 
-template<typename KType, typename VType>
-struct KVWrapper {
-    KType* key_ptr;
-    VType* value_ptr;
-    KVWrapper(KType* key_ptr_, VType* value_ptr_): key_ptr(key_ptr_), value_ptr(value_ptr_) {}
+// a version of a key, the versions of a key are ordered newest first
+template<typename KType>
+struct SequencedKey {
+    KType key;
+    uint64_t sequence;
+
+    bool operator<(const SequencedKey& other) const {
+        if (key < other.key) {
+            return true;
+        }
+        return !(other.key < key) && sequence > other.sequence;
+    }
+
+    bool operator==(const SequencedKey& other) const {
+        return key == other.key && sequence == other.sequence;
+    }
+};
+
+template<typename KType>
+struct HeapSize<SequencedKey<KType>> {
+    static size_t size(const SequencedKey<KType> &obj) {
+        return HeapSize<KType>::size(obj.key);
+    }
 };
 
+// Every write is a new version of its key, tagged with the sequence number of the write,
+// so readers at an older sequence number still see the versions they saw before
 template<typename KType, typename VType>
 class MemTable {
     private:
-        SkipList<KType, VType> skip_list;
+        SkipList<SequencedKey<KType>, VType> skip_list;
+        RangeTombstoneList<KType> range_tombstones;
         uint64_t size;
+        // approximate bytes used by range_tombstones
+        uint64_t range_tombstone_memory_usage{0};
     public:
         MemTable(int max_level = 16, float probability = 0.5):
             skip_list(max_level, probability), size(0)
         {}
 
-        void put(const KType key, const VType value) {
-            size += skip_list.put(key, value);
+        // expire_time is the time an EXPIRING_VALUE expires at, in ms since the epoch.
+        // A DELETION hides the older versions of key, a MERGE is an operand applied to them
+        void put(uint64_t sequence, const KType key, const VType value, EntryType type = EntryType::VALUE, uint64_t expire_time = 0) {
+            size += skip_list.put({key, sequence}, value, type, expire_time);
+        }
+
+        // add a tombstone of key
+        void remove(uint64_t sequence, const KType key) {
+            put(sequence, key, VType(), EntryType::DELETION);
+        }
+
+        // add a merge operand of key. It is folded right away into the newest version of key if that is
+        // a value in this memtable, the result is a new version. Values merged into keep their expire time,
+        // values expired at now count as deleted
+        template<typename MergeFunc>
+        void merge(uint64_t sequence, const KType key, const VType operand, const MergeFunc& merge, uint64_t now) {
+            auto iter = skip_list.lowerBound({key, sequence});
+            bool found = iter.valid() && iter.key().key == key;
+            uint64_t range_deletion_sequence = range_tombstones.getSequence(key, sequence);
+            if (found ? iter.key().sequence < range_deletion_sequence : range_deletion_sequence > 0) {
+                // nothing older is left to apply the operand to
+                put(sequence, key, operand, EntryType::VALUE);
+            } else if (!found || iter.type() == EntryType::MERGE) {
+                put(sequence, key, operand, EntryType::MERGE);
+            } else if (iter.type() == EntryType::DELETION || (iter.type() == EntryType::EXPIRING_VALUE && iter.expire_time() <= now)) {
+                put(sequence, key, operand, EntryType::VALUE);
+            } else {
+                put(sequence, key, merge(iter.value(), operand), iter.type(), iter.expire_time());
+            }
+        }
+
+        // delete the versions of the keys in [begin, end) older than sequence
+        void deleteRange(uint64_t sequence, const KType& begin, const KType& end) {
+            if (!(begin < end)) {
+                return;
+            }
+            range_tombstones.add(begin, end, sequence);
+            range_tombstone_memory_usage += 2 * (sizeof(KType) + HeapSize<KType>::size(begin)) + 4 * sizeof(void*) + sizeof(uint64_t);
+        }
+
+        // sequence number of the newest range tombstone covering key visible at snapshot, 0 if there is none
+        uint64_t getRangeDeletionSequence(const KType& key, uint64_t snapshot) const {
+            return range_tombstones.getSequence(key, snapshot);
         }
 
-        unique_ptr<VType> get(const KType& key) const {
-            return skip_list.get(key);
+        // whether a version of a key in [begin, end] is in the memtable
+        bool overlaps(const KType& begin, const KType& end) const {
+            auto iter = skip_list.lowerBound({begin, UINT64_MAX});
+            return iter.valid() && !(end < iter.key().key);
         }
 
-        void remove(const KType key) {
-            size += skip_list.insert(key, DeleteMarker<VType>::value());
+        const RangeTombstoneList<KType>& get_range_tombstones() const {
+            return range_tombstones;
         }
 
         uint64_t get_size() const {
-            return size;
+            return size + range_tombstones.size();
         }
 
-        int get_min_max_key(KType &min_key, KType &max_key) const {
-            return skip_list.get_min_max_key(min_key, max_key);
+        // approximate bytes used by keys, values, skip list nodes and range tombstones
+        uint64_t get_memory_usage() const {
+            return skip_list.memory_usage + range_tombstone_memory_usage;
         }
 
-        vector<KVWrapper<KType, VType>> get_all_kv() const {
-            vector<KVWrapper<KType, VType>> kv_wrappers;
-            auto current = skip_list.head;
-            while(current->next[0] != nullptr) {
-                kv_wrappers.push_back(KVWrapper(&(current->next[0]->key), &(current->next[0]->value)));
-                current = current->next[0];
-            }
-            return kv_wrappers;
+        using Iterator = typename SkipList<SequencedKey<KType>, VType>::Iterator;
+
+        // iterate over all versions in key order, newest first for each key
+        Iterator begin() const {
+            return skip_list.begin();
+        }
+
+        // iterator at the newest version of key visible at snapshot, if any. It is at
+        // a greater key or invalid if there is none, the older versions of key follow it
+        Iterator lowerBound(const KType& key, uint64_t snapshot) const {
+            return skip_list.lowerBound({key, snapshot});
         }
 };
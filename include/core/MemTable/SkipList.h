@@ -5,6 +5,8 @@
 #include <random>
 #include <vector>
 #include <format>
+#include <string>
+#include "EntryType.h"
 
 using std::vector;
 using std::shared_ptr;
@@ -12,17 +14,38 @@ using std::make_shared;
 using std::unique_ptr;
 using std::make_unique;
 
+// bytes a key or value owns outside of the skip list node
+template<typename T>
+struct HeapSize {
+    static size_t size(const T &) {
+        return 0;
+    }
+};
+
+template<>
+struct HeapSize<std::string> {
+    static size_t size(const std::string &obj) {
+        return obj.size();
+    }
+};
+
 template<typename KType, typename VType>
 struct SkipList{
         struct Node {
             KType key;
             VType value;
+            // VALUE, DELETION, MERGE or EXPIRING_VALUE
+            EntryType type;
+            // ms since the epoch, EXPIRING_VALUE only
+            uint64_t expire_time;
             int level;
             // next[i] is the next node at level i
             vector<shared_ptr<Node>> next; 
-            explicit Node(KType key_, VType value_, int level_) : 
+            explicit Node(KType key_, VType value_, EntryType type_, uint64_t expire_time_, int level_) : 
                 key(key_), 
                 value(value_), 
+                type(type_),
+                expire_time(expire_time_),
                 level(level_) {
                 next.resize(level_ + 1);
             }
@@ -30,6 +53,8 @@ struct SkipList{
         shared_ptr<Node> head;
         int max_level;
         float probability;
+        // bytes used by keys, values and nodes (without head)
+        uint64_t memory_usage{0};
         std::mt19937 gen{std::random_device{}()};
         std::uniform_real_distribution<float> dist{0, 1};
         int randomLevel() {
@@ -38,16 +63,22 @@ struct SkipList{
                 level++;
             return level;
         }
+
+        static uint64_t nodeSize(const KType &key, const VType &value, int level) {
+            // the node shares one allocation with its control block (make_shared)
+            return sizeof(Node) + 2 * sizeof(void*) + (level + 1) * sizeof(shared_ptr<Node>) +
+                HeapSize<KType>::size(key) + HeapSize<VType>::size(value);
+        }
     public:
         SkipList(int max_level_ = 16, float probability_ = 0.5):
-            head(std::make_shared<Node>(KType(), VType(), max_level_)), 
+            head(std::make_shared<Node>(KType(), VType(), EntryType::VALUE, 0, max_level_)), 
             max_level(max_level_), 
             probability(probability_)
         {}
 
         // return 0 if the key already exists
         // return 1 if the key not exists
-        int put(const KType key, const VType value) {
+        int put(const KType key, const VType value, EntryType type = EntryType::VALUE, uint64_t expire_time = 0) {
             vector<shared_ptr<Node>> update(max_level + 1);
             auto current = head;
         
@@ -61,14 +92,19 @@ struct SkipList{
             
             // check if the key already exists
             if (current->next[0] && current->next[0]->key == key) {
+                memory_usage -= HeapSize<VType>::size(current->next[0]->value);
+                memory_usage += HeapSize<VType>::size(value);
                 current->next[0]->value = value;
+                current->next[0]->type = type;
+                current->next[0]->expire_time = expire_time;
                 return 0;
             }
 
             const int level = randomLevel();
+            memory_usage += nodeSize(key, value, level);
             // create a new node with random level
             // use move semantics to avoid copying the value
-            auto new_node = make_shared<Node>(std::move(key), std::move(value), level);
+            auto new_node = make_shared<Node>(std::move(key), std::move(value), type, expire_time, level);
         
             for (int i = 0; i <= level; ++i) {
                 new_node->next[i] = update[i]->next[i];
@@ -77,7 +113,8 @@ struct SkipList{
             return 1;
         }
         
-        unique_ptr<VType> get(const KType& key) const {
+        // type and expire_time are set to those of the entry if it is found
+        unique_ptr<VType> get(const KType& key, EntryType* type = nullptr, uint64_t* expire_time = nullptr) const {
             auto current = head;
             for (int i = max_level; i >= 0; i--) {
                 while (current->next[i] && current->next[i]->key < key) {
@@ -86,6 +123,12 @@ struct SkipList{
             }
             current = current->next[0];
             if (current && current->key == key) {
+                if (type != nullptr) {
+                    *type = current->type;
+                }
+                if (expire_time != nullptr) {
+                    *expire_time = current->expire_time;
+                }
                 return make_unique<VType>(current->value);
             }
             return nullptr;
@@ -102,6 +145,7 @@ struct SkipList{
             }
             current = current->next[0];
             if (current && current->key == key) {
+                memory_usage -= nodeSize(current->key, current->value, current->level);
                 for (int i = 0; i <= max_level; i++) {
                     if (update[i]->next[i] != current) {
                         break;
@@ -127,6 +171,53 @@ struct SkipList{
             }
         }
 
+        // forward iterator over the nodes in key order
+        class Iterator {
+            private:
+                shared_ptr<Node> node;
+            public:
+                explicit Iterator(shared_ptr<Node> node_): node(std::move(node_)) {}
+
+                bool valid() const {
+                    return node != nullptr;
+                }
+
+                void next() {
+                    node = node->next[0];
+                }
+
+                const KType& key() const {
+                    return node->key;
+                }
+
+                const VType& value() const {
+                    return node->value;
+                }
+
+                EntryType type() const {
+                    return node->type;
+                }
+
+                uint64_t expire_time() const {
+                    return node->expire_time;
+                }
+        };
+
+        Iterator begin() const {
+            return Iterator(head->next[0]);
+        }
+
+        // iterator at the first node whose key is not less than key
+        Iterator lowerBound(const KType& key) const {
+            auto current = head;
+            for (int i = max_level; i >= 0; i--) {
+                while (current->next[i] && current->next[i]->key < key) {
+                    current = current->next[i];
+                }
+            }
+            return Iterator(current->next[0]);
+        }
+
         int get_min_max_key(KType &min_key, KType &max_key) const {
             if (head->next[0] == nullptr) {
                 return -1;
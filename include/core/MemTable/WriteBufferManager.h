@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+// Tracks the memtable bytes of every store sharing it, and asks the store with the
+// largest mutable memtable to flush when the total exceeds buffer_size.
+class WriteBufferManager {
+    private:
+        struct Owner {
+            // bytes of the owner's mutable memtable
+            uint64_t mutable_memory_usage;
+            std::function<void()> flush;
+        };
+
+        uint64_t buffer_size;
+        // bytes of all memtables, including the ones being flushed
+        std::atomic<uint64_t> memory_usage{0};
+
+        // guards owners and next_owner_id
+        std::mutex owners_mutex;
+        // held while a flush callback is running, so an owner can't unregister during it
+        std::mutex flush_mutex;
+        std::map<uint64_t, Owner> owners;
+        uint64_t next_owner_id{0};
+    public:
+        explicit WriteBufferManager(uint64_t buffer_size_): buffer_size(buffer_size_) {}
+
+        // flush is called (without any lock of the manager held) when the owner should
+        // switch and flush its mutable memtable
+        uint64_t registerOwner(std::function<void()> flush) {
+            std::lock_guard guard(owners_mutex);
+            owners.emplace(next_owner_id, Owner{0, std::move(flush)});
+            return next_owner_id++;
+        }
+
+        // the owner must have freed all its memory before unregistering
+        void unregisterOwner(uint64_t owner_id) {
+            std::lock_guard flush_guard(flush_mutex);
+            std::lock_guard guard(owners_mutex);
+            owners.erase(owner_id);
+        }
+
+        // the mutable memtable of owner grew by bytes, they are counted even for an unknown owner
+        // as freeMem doesn't know the owner either
+        void reserveMem(uint64_t owner_id, uint64_t bytes) {
+            std::lock_guard guard(owners_mutex);
+            memory_usage += bytes;
+            auto iter = owners.find(owner_id);
+            if (iter != owners.end()) {
+                iter->second.mutable_memory_usage += bytes;
+            }
+        }
+
+        // bytes of owner are no longer in its mutable memtable (it was switched),
+        // they are still counted until freeMem. Unknown owners are ignored
+        void scheduleFreeMem(uint64_t owner_id, uint64_t bytes) {
+            std::lock_guard guard(owners_mutex);
+            auto iter = owners.find(owner_id);
+            if (iter != owners.end()) {
+                iter->second.mutable_memory_usage -= bytes;
+            }
+        }
+
+        void freeMem(uint64_t bytes) {
+            memory_usage -= bytes;
+        }
+
+        uint64_t get_memory_usage() const {
+            return memory_usage;
+        }
+
+        uint64_t get_buffer_size() const {
+            return buffer_size;
+        }
+
+        bool shouldFlush() const {
+            return memory_usage > buffer_size;
+        }
+
+        // ask the owner with the largest mutable memtable to flush if the budget is exceeded,
+        // does nothing if another thread is already doing so
+        void maybeFlush() {
+            if (!shouldFlush()) {
+                return;
+            }
+            std::unique_lock flush_guard(flush_mutex, std::try_to_lock);
+            if (!flush_guard.owns_lock()) {
+                return;
+            }
+            std::function<void()> flush;
+            {
+                std::lock_guard guard(owners_mutex);
+                uint64_t max_memory_usage = 0;
+                for (const auto& [owner_id, owner]: owners) {
+                    if (owner.flush && owner.mutable_memory_usage > max_memory_usage) {
+                        max_memory_usage = owner.mutable_memory_usage;
+                        flush = owner.flush;
+                    }
+                }
+            }
+            if (flush) {
+                flush();
+            }
+        }
+};
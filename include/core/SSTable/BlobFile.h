@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include "FileWriter.h"
+#include "Crc32c.h"
+#include "KeyCodec.h"
+
+// Location of a value separated into a blob file, stored in the sstable instead of the value
+struct BlobIndex {
+    uint64_t file_number;
+    // offset and size of the record of the value in the blob file
+    uint64_t offset;
+    uint64_t size;
+
+    std::string encode() const {
+        std::string data(sizeof(BlobIndex), '\0');
+        memcpy(data.data(), this, sizeof(BlobIndex));
+        return data;
+    }
+
+    int decode(const std::string& data) {
+        if (data.size() != sizeof(BlobIndex)) {
+            return -1;
+        }
+        memcpy(this, data.data(), sizeof(BlobIndex));
+        return 0;
+    }
+};
+
+struct BlobFileMeta {
+    uint64_t file_number;
+    // bytes of all records in the file
+    uint64_t total_bytes;
+    // bytes of the records still referenced by an sstable, the rest is garbage
+    uint64_t live_bytes;
+
+    double getGarbageRatio() const {
+        return total_bytes == 0 ? 0 : 1.0 - static_cast<double>(live_bytes) / total_bytes;
+    }
+};
+
+class BlobFileReader {
+    public:
+        // key size and value size
+        static constexpr uint64_t kRecordHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+        // read the value of the record blob_index points to, optionally verifying the whole record
+        static int read(const std::string& filename, const BlobIndex& blob_index, std::string& value_str, bool verify_checksums = true) {
+            std::ifstream file(filename, std::ios::binary | std::ios::in);
+            std::string record(blob_index.size, '\0');
+            file.seekg(blob_index.offset);
+            if (blob_index.size < kRecordHeaderSize + sizeof(uint32_t) || !file.read(record.data(), record.size())) {
+                printf("Error: read blob of %s failed.\n", filename.c_str());
+                return -1;
+            }
+            uint32_t key_size, checksum;
+            uint64_t value_size;
+            memcpy(&key_size, record.data(), sizeof(key_size));
+            memcpy(&value_size, record.data() + sizeof(key_size), sizeof(value_size));
+            memcpy(&checksum, record.data() + record.size() - sizeof(checksum), sizeof(checksum));
+            if (kRecordHeaderSize + key_size + value_size + sizeof(checksum) != record.size() ||
+                (verify_checksums && Crc32c::value(record.data(), record.size() - sizeof(checksum)) != checksum)) {
+                printf("Error: checksum mismatch in blob of %s.\n", filename.c_str());
+                return -1;
+            }
+            value_str.assign(record, kRecordHeaderSize + key_size, value_size);
+            return 0;
+        }
+};
+
+// Appends large values to a blob file, every record is
+// [key size (u32)][value size (u64)][key (KeyCodec)][value][crc32c of the rest]
+// so the file can be scanned and verified without the sstables referencing it.
+template<typename KType>
+class BlobFileBuilder {
+    private:
+        FileWriter writer;
+        BlobFileMeta meta{0, 0, 0};
+    public:
+        explicit BlobFileBuilder(const FileWriterOptions& options = FileWriterOptions()): writer(options) {}
+
+        int open(const std::string& filename, uint64_t file_number) {
+            meta.file_number = file_number;
+            return writer.open(filename);
+        }
+
+        // append a value, blob_index is set to its location
+        int add(const KType& key, std::string_view value_str, BlobIndex& blob_index) {
+            std::string record_header(BlobFileReader::kRecordHeaderSize, '\0');
+            KeyCodec<KType>::put(record_header, key);
+            uint32_t key_size = record_header.size() - BlobFileReader::kRecordHeaderSize;
+            uint64_t value_size = value_str.size();
+            memcpy(record_header.data(), &key_size, sizeof(key_size));
+            memcpy(record_header.data() + sizeof(key_size), &value_size, sizeof(value_size));
+            uint32_t checksum = Crc32c::extend(Crc32c::value(record_header), value_str.data(), value_str.size());
+
+            blob_index = BlobIndex{meta.file_number, writer.get_file_size(), record_header.size() + value_size + sizeof(checksum)};
+            meta.total_bytes += blob_index.size;
+            meta.live_bytes += blob_index.size;
+            return writer.append(record_header.data(), record_header.size()) ||
+                writer.append(value_str.data(), value_str.size()) || writer.append(checksum) ? -1 : 0;
+        }
+
+        int finish() {
+            return writer.close();
+        }
+
+        const BlobFileMeta& get_meta() const {
+            return meta;
+        }
+};
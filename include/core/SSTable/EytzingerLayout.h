@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Sorted keys stored in Eytzinger (breadth first) order: the children of node k are 2k and 2k + 1,
+// so a search walks down one implicit tree and the nodes of the next levels are prefetched
+// while the current one is compared, without branches to mispredict.
+// Keys and their positions in sorted order are kept in separate arrays.
+class EytzingerLayout {
+    private:
+        // nodes are 1-based, keys[0] is unused
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> positions;
+
+        // fill the subtree of node k with sorted_keys[i...] in order, returns the next i
+        size_t build(const std::vector<uint64_t>& sorted_keys, size_t i, size_t k) {
+            if (k < keys.size()) {
+                i = build(sorted_keys, i, 2 * k);
+                keys[k] = sorted_keys[i];
+                positions[k] = i++;
+                i = build(sorted_keys, i, 2 * k + 1);
+            }
+            return i;
+        }
+    public:
+        explicit EytzingerLayout(const std::vector<uint64_t>& sorted_keys):
+            keys(sorted_keys.size() + 1), positions(sorted_keys.size() + 1) {
+            build(sorted_keys, 0, 1);
+        }
+
+        // position in sorted order of the first key not less than key, the number of keys if there is none
+        size_t lowerBound(uint64_t key) const {
+            size_t n = keys.size() - 1;
+            size_t k = 1;
+            while (k <= n) {
+#if defined(__GNUC__) || defined(__clang__)
+                // the 8 keys of one cache line are 3 levels down
+                __builtin_prefetch(keys.data() + std::min(k * 8, n));
+#endif
+                k = 2 * k + (keys[k] < key);
+            }
+            // the last node where the search went left is the answer,
+            // drop the trailing right turns and that left turn
+            k >>= std::countr_one(k) + 1;
+            return k == 0 ? n : positions[k];
+        }
+
+        uint64_t getMemoryUsage() const {
+            return keys.capacity() * sizeof(uint64_t) + positions.capacity() * sizeof(uint32_t);
+        }
+};
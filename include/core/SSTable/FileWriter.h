@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include "RateLimiter.h"
+
+struct FileWriterOptions {
+    // bytes buffered before they are written to the file, rounded up to kAlignment
+    size_t buffer_size{4 * 1024 * 1024};
+    // bypass the page cache, falls back to buffered io if the file system doesn't support it
+    bool use_direct_io{false};
+    std::shared_ptr<RateLimiter> rate_limiter;
+    IOPriority priority{IOPriority::LOW};
+};
+
+// Writes a file sequentially through a large aligned buffer,
+// the file is synced once when it is closed.
+class FileWriter {
+    public:
+        // alignment of the buffer and of every write, as required by O_DIRECT
+        static constexpr size_t kAlignment = 4096;
+    private:
+        struct AlignedDelete {
+            void operator()(char* ptr) const {
+                ::operator delete[](ptr, std::align_val_t(kAlignment));
+            }
+        };
+
+        FileWriterOptions options;
+        std::string filename;
+        int fd{-1};
+        bool direct_io{false};
+        std::unique_ptr<char[], AlignedDelete> buffer;
+        size_t capacity{0};
+        size_t buffer_pos{0};
+        // bytes appended so far
+        uint64_t file_size{0};
+
+        int writeFully(const char* data, size_t size) {
+            if (options.rate_limiter) {
+                options.rate_limiter->request(size, options.priority);
+            }
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    printf("Error: write %s failed: %s\n", filename.c_str(), strerror(errno));
+                    return -1;
+                }
+                data += written;
+                size -= written;
+            }
+            return 0;
+        }
+
+    public:
+        explicit FileWriter(const FileWriterOptions& options_ = FileWriterOptions()): options(options_) {
+            capacity = std::max<size_t>((options.buffer_size + kAlignment - 1) / kAlignment * kAlignment, kAlignment);
+            buffer.reset(static_cast<char*>(::operator new[](capacity, std::align_val_t(kAlignment))));
+        }
+
+        FileWriter(const FileWriter&) = delete;
+        FileWriter& operator=(const FileWriter&) = delete;
+
+        ~FileWriter() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        int open(const std::string& filename_) {
+            filename = filename_;
+            int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+            if (options.use_direct_io) {
+                fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+                direct_io = fd >= 0;
+            }
+#endif
+            if (fd < 0) {
+                fd = ::open(filename.c_str(), flags, 0644);
+            }
+            if (fd < 0) {
+                printf("Error: open %s failed: %s\n", filename.c_str(), strerror(errno));
+                return -1;
+            }
+            return 0;
+        }
+
+        int append(const char* data, size_t size) {
+            file_size += size;
+            while (size > 0) {
+                size_t copy_size = std::min(size, capacity - buffer_pos);
+                memcpy(buffer.get() + buffer_pos, data, copy_size);
+                buffer_pos += copy_size;
+                data += copy_size;
+                size -= copy_size;
+                if (buffer_pos == capacity && flush()) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+
+        template<typename T>
+        int append(const T& obj) {
+            return append(reinterpret_cast<const char*>(&obj), sizeof(obj));
+        }
+
+        // write the buffered bytes, with direct io only whole aligned blocks are written
+        int flush() {
+            size_t write_size = direct_io ? buffer_pos / kAlignment * kAlignment : buffer_pos;
+            if (write_size == 0) {
+                return 0;
+            }
+            if (writeFully(buffer.get(), write_size)) {
+                return -1;
+            }
+            memmove(buffer.get(), buffer.get() + write_size, buffer_pos - write_size);
+            buffer_pos -= write_size;
+            return 0;
+        }
+
+        // flush, sync and close the file
+        int close() {
+            if (flush()) {
+                return -1;
+            }
+            if (buffer_pos > 0) {
+                // direct io: pad the tail to a whole block, then cut the padding off
+                memset(buffer.get() + buffer_pos, 0, kAlignment - buffer_pos);
+                if (writeFully(buffer.get(), kAlignment) || ::ftruncate(fd, file_size)) {
+                    printf("Error: write tail of %s failed: %s\n", filename.c_str(), strerror(errno));
+                    return -1;
+                }
+                buffer_pos = 0;
+            }
+            if (::fsync(fd)) {
+                printf("Error: sync %s failed: %s\n", filename.c_str(), strerror(errno));
+                return -1;
+            }
+            int close_result = ::close(fd);
+            fd = -1;
+            if (close_result) {
+                printf("Error: close %s failed: %s\n", filename.c_str(), strerror(errno));
+                return -1;
+            }
+            return 0;
+        }
+
+        uint64_t get_file_size() const {
+            return file_size;
+        }
+
+        // whether the file was opened with O_DIRECT, use_direct_io falls back to buffered io without it
+        bool is_direct_io() const {
+            return direct_io;
+        }
+
+        // sync the entries of directory dir, so files created or renamed in it survive a crash
+        static int syncDirectory(const std::string& dir) {
+            int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dir_fd < 0) {
+                printf("Error: open directory %s failed: %s\n", dir.c_str(), strerror(errno));
+                return -1;
+            }
+            int sync_result = ::fsync(dir_fd);
+            if (sync_result) {
+                printf("Error: sync directory %s failed: %s\n", dir.c_str(), strerror(errno));
+            }
+            ::close(dir_fd);
+            return sync_result ? -1 : 0;
+        }
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Piecewise linear model of the positions of sorted keys, in the spirit of the PGM index.
+// Every segment predicts the position of its keys with an error of at most error_bound,
+// segments are built greedily in one pass by shrinking the cone of slopes that keep all keys
+// of the segment within the error bound.
+class PiecewiseLinearModel {
+    private:
+        struct Segment {
+            uint64_t first_key;
+            double slope;
+            size_t first_position;
+            size_t last_position;
+        };
+
+        size_t error_bound;
+        size_t key_count;
+        std::vector<Segment> segments;
+
+    public:
+        PiecewiseLinearModel(const std::vector<uint64_t>& keys, size_t error_bound_):
+            error_bound(error_bound_), key_count(keys.size()) {
+            size_t first = 0;
+            double min_slope = 0, max_slope = std::numeric_limits<double>::infinity();
+            for (size_t i = 1; i <= keys.size(); i++) {
+                if (i < keys.size()) {
+                    // a repeated key is found at the position of its first copy
+                    if (keys[i] == keys[i - 1]) {
+                        continue;
+                    }
+                    double dx = static_cast<double>(keys[i] - keys[first]);
+                    double dy = static_cast<double>(i - first);
+                    double low = (dy - error_bound) / dx, high = (dy + error_bound) / dx;
+                    if (dy / dx >= min_slope && dy / dx <= max_slope) {
+                        min_slope = std::max(min_slope, low);
+                        max_slope = std::min(max_slope, high);
+                        continue;
+                    }
+                }
+                // the key at i doesn't fit, close the segment before it
+                double slope = std::isinf(max_slope) ? min_slope : (min_slope + max_slope) / 2;
+                segments.push_back(Segment{keys[first], slope, first, i - 1});
+                first = i;
+                min_slope = 0;
+                max_slope = std::numeric_limits<double>::infinity();
+            }
+        }
+
+        // range [first, last] of positions that holds the position of the first key not less than key
+        std::pair<size_t, size_t> predict(uint64_t key) const {
+            if (segments.empty() || key <= segments.front().first_key) {
+                return {0, 0};
+            }
+            auto iter = std::upper_bound(segments.begin(), segments.end(), key,
+                [](uint64_t key, const Segment& segment) { return key < segment.first_key; }) - 1;
+            // keys after the last key of the segment belong to the position after it
+            double position = iter->first_position + iter->slope * static_cast<double>(key - iter->first_key);
+            position = std::clamp(position, static_cast<double>(iter->first_position), static_cast<double>(iter->last_position + 1));
+            auto predicted = static_cast<size_t>(position);
+            size_t first = predicted > error_bound + 1 ? predicted - error_bound - 1 : 0;
+            size_t last = std::min(predicted + error_bound + 2, key_count);
+            return {first, last};
+        }
+
+        size_t get_segment_count() const {
+            return segments.size();
+        }
+
+        uint64_t getMemoryUsage() const {
+            return segments.capacity() * sizeof(Segment);
+        }
+};
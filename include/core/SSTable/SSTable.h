@@ -1,7 +1,18 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <string>
 #include "Hash.h"
+#include "FileWriter.h"
+#include "Compression.h"
+#include "Crc32c.h"
+#include "KeyCodec.h"
+#include "EntryType.h"
+#include "RangeTombstoneList.h"
+#include "SSTableIndex.h"
 
 template<typename KType>
 struct BloomFilter {
@@ -14,14 +25,14 @@ struct BloomFilter {
     explicit BloomFilter(uint64_t bit_num_ = 81920):bit_num(bit_num_),bit_array(bit_num_, false) {}
 
     void put(const KType &key){
-        auto hash = hash_wrapper.hash(key, sizeof(key));
+        auto hash = hash_wrapper.hash(key, KeyCodec<KType>::size(key));
         for(auto h: hash) {
             bit_array[h % bit_num] = true;
         }
     }
 
     bool contains(const KType &key) {
-        auto hash = hash_wrapper.hash(key, sizeof(key));
+        auto hash = hash_wrapper.hash(key, KeyCodec<KType>::size(key));
         for(auto h: hash) {
             if(!bit_array[h % bit_num]) {
                 return false;
@@ -31,23 +42,52 @@ struct BloomFilter {
     }
 };
 
+// written at the end of the file, after the data blocks, bloom filter, index, block handles,
+// compression dictionary and range tombstones. min_key and max_key are encoded by KeyCodec ahead
+// of the other fields, they bound the keys of the entries and the range tombstones
 template<typename KType>
 struct SSTableHeader {
-    uint64_t timestamp;
-    uint64_t kv_count;
     KType min_key;
     KType max_key;
+    uint64_t timestamp;
+    // sequence number of the newest entry or range tombstone
+    uint64_t max_sequence;
+    uint64_t kv_count;
+    // bytes of (uncompressed) values
+    uint64_t data_size;
+    uint64_t block_count;
+    // bytes of the encoded index entries, they are followed by the restart points
+    uint64_t index_size;
+    uint64_t restart_count;
+    // bytes of the zstd dictionary, 0 if blocks are compressed without one
+    uint64_t dict_size;
+    // bytes of the encoded range tombstones
+    uint64_t range_deletion_size;
+    // bytes of the encoded min_key and max_key
+    uint64_t key_size;
+    // crc32c of everything after the data blocks up to the checksum
+    uint32_t checksum;
 
-    uint64_t getHeaderSpace() {
-        return sizeof(timestamp) + sizeof(kv_count) + sizeof(min_key) + sizeof(max_key);
+    // bytes of the fields after min_key and max_key
+    static constexpr uint64_t kFixedSize = 10 * sizeof(uint64_t) + sizeof(uint32_t);
+
+    uint64_t getHeaderSpace() const {
+        return key_size + kFixedSize;
     }
 };
 
-struct SSTableIndex
+// location of a data block, the block is followed by a trailer of its CompressionType
+// and the crc32c of the block and the type
+struct BlockHandle
 {
-    uint64_t key;
-    uint64_t offset;
-    SSTableIndex(uint64_t key_, uint64_t offset_): key(key_), offset(offset_) {}
+    static constexpr size_t kTrailerSize = sizeof(uint8_t) + sizeof(uint32_t);
+
+    // offset and size of the (compressed) block in the file, without the trailer
+    uint64_t file_offset;
+    uint64_t size;
+    // offset of the first entry of the block in the uncompressed data
+    uint64_t data_offset;
+    BlockHandle(uint64_t file_offset_, uint64_t size_, uint64_t data_offset_): file_offset(file_offset_), size(size_), data_offset(data_offset_) {}
 };
 
 
@@ -56,34 +96,194 @@ class SSTable {
 public:
     uint32_t level;
     uint32_t order;
+    uint64_t file_size{0};
     
     SSTableHeader<KType> header;
     BloomFilter<KType> bloom_filter;
-    vector<SSTableIndex> index;
+    SSTableIndex<KType> index;
+    vector<BlockHandle> blocks;
+    // dictionary of the zstd compressed blocks, may be null
+    shared_ptr<const CompressionDict> compression_dict;
+    // deleted ranges, they hide the versions of keys older than them
+    RangeTombstoneList<KType> range_tombstones;
+    // bytes of values in each blob file referenced by this sstable, kept in memory only
+    std::map<uint64_t, uint64_t> blob_bytes;
+    // sequence number of all entries of an sstable ingested into a store, which is newer than the
+    // sequence numbers in the file. 0 if the entries have their own, kept in memory only
+    uint64_t global_sequence{0};
 
     size_t getIndexSpace() const
     {
-        return index.size() * (sizeof(SSTableIndex::key) + sizeof(SSTableIndex::offset));
+        return index.get_data().size() + index.get_restarts().size() * sizeof(uint32_t);
+    }
+
+    // uncompressed bytes of blocks[i]
+    uint64_t getBlockDataSize(size_t i) const
+    {
+        return (i + 1 < blocks.size() ? blocks[i + 1].data_offset : header.data_size) - blocks[i].data_offset;
+    }
+
+    // the block holding the entry at offset in the uncompressed data
+    size_t findBlock(uint64_t offset) const
+    {
+        auto iter = std::upper_bound(blocks.begin(), blocks.end(), offset,
+            [](uint64_t offset, const BlockHandle& block) { return offset < block.data_offset; });
+        return iter - blocks.begin() - 1;
     }
 
+    // write bloom filter, index, block handles, dictionary, range tombstones and header,
+    // they follow the data blocks in the file
+    int writeToFile(FileWriter& writer)
+    {
+        // everything but the checksum itself is covered by it
+        header.checksum = 0;
+        auto append = [&](const char* data, size_t size) {
+            header.checksum = Crc32c::extend(header.checksum, data, size);
+            return writer.append(data, size);
+        };
+        auto appendFixed = [&](const auto& obj) {
+            return append(reinterpret_cast<const char*>(&obj), sizeof(obj));
+        };
+
+        vector<uint8_t> bloom_bytes(bloom_filter.bit_array.size() / 8, 0);
+        for(size_t i = 0; i < bloom_filter.bit_array.size(); i++)
+            bloom_bytes[i / 8] |= (bloom_filter.bit_array[i] << (8 - i % 8 - 1));
+        if (append(reinterpret_cast<const char*>(bloom_bytes.data()), bloom_bytes.size()))
+            return -1;
+        header.index_size = index.get_data().size();
+        header.restart_count = index.get_restarts().size();
+        if (append(index.get_data().data(), index.get_data().size()))
+            return -1;
+        for(uint32_t restart: index.get_restarts()) {
+            if (appendFixed(restart))
+                return -1;
+        }
+        for(const auto& block: blocks) {
+            if (appendFixed(block.file_offset) || appendFixed(block.size) || appendFixed(block.data_offset))
+                return -1;
+        }
+        if (compression_dict != nullptr &&
+            append(compression_dict->get_data().data(), compression_dict->get_data().size()))
+            return -1;
+        std::string range_deletions;
+        for (const auto& [begin, fragment]: range_tombstones) {
+            KeyCodec<KType>::put(range_deletions, begin);
+            KeyCodec<KType>::put(range_deletions, fragment.end);
+            Varint::put(range_deletions, fragment.sequences.size());
+            for (uint64_t sequence: fragment.sequences) {
+                Varint::put(range_deletions, sequence);
+            }
+        }
+        header.range_deletion_size = range_deletions.size();
+        if (append(range_deletions.data(), range_deletions.size()))
+            return -1;
+        std::string keys;
+        KeyCodec<KType>::put(keys, header.min_key);
+        KeyCodec<KType>::put(keys, header.max_key);
+        header.key_size = keys.size();
+        if (append(keys.data(), keys.size()) || appendFixed(header.timestamp) || appendFixed(header.max_sequence) ||
+            appendFixed(header.kv_count) || appendFixed(header.data_size) || appendFixed(header.block_count) ||
+            appendFixed(header.index_size) || appendFixed(header.restart_count) || appendFixed(header.dict_size) ||
+            appendFixed(header.range_deletion_size) || appendFixed(header.key_size))
+            return -1;
+        return writer.append(header.checksum);
+    }
 
-    void writeToFile(std::ofstream& ofs)
+    // read back what writeToFile wrote to an sstable file, level and order are not stored in the file
+    int readFromFile(const std::string& filename)
     {
-        ofs.write(reinterpret_cast<const char*>(&header.timestamp), sizeof(header.timestamp));
-        ofs.write(reinterpret_cast<const char*>(&header.kv_count), sizeof(header.kv_count));
-        ofs.write(reinterpret_cast<const char*>(&header.min_key), sizeof(header.min_key));
-        ofs.write(reinterpret_cast<const char*>(&header.max_key), sizeof(header.max_key));
-        for(size_t i = 0; i < bloom_filter.bit_array.size(); i += sizeof(bool) * 8)
-        {
-            uint8_t byte = 0;
-            for(int j = 0; j < 8; j++)
-                byte |= (bloom_filter.bit_array[i + j] << (8 - j - 1));
-            ofs.write(reinterpret_cast<const char*>(&byte), sizeof(byte));
+        std::ifstream file(filename, std::ios::binary | std::ios::in | std::ios::ate);
+        if (!file) {
+            printf("Error: open sstable %s failed.\n", filename.c_str());
+            return -1;
+        }
+        file_size = file.tellg();
+        // the fixed fields of the header are at the end, they give the size of everything before them
+        char fixed[SSTableHeader<KType>::kFixedSize];
+        if (file_size < sizeof(fixed) || !file.seekg(file_size - sizeof(fixed)) || !file.read(fixed, sizeof(fixed))) {
+            printf("Error: read sstable %s failed.\n", filename.c_str());
+            return -1;
+        }
+        const char* p = fixed;
+        for (uint64_t* field: {&header.timestamp, &header.max_sequence, &header.kv_count, &header.data_size, &header.block_count,
+            &header.index_size, &header.restart_count, &header.dict_size, &header.range_deletion_size, &header.key_size}) {
+            memcpy(field, p, sizeof(*field));
+            p += sizeof(*field);
+        }
+        memcpy(&header.checksum, p, sizeof(header.checksum));
+
+        uint64_t bloom_size = bloom_filter.bit_num / 8;
+        uint64_t handle_size = 3 * sizeof(uint64_t);
+        uint64_t meta_size = bloom_size + header.index_size + header.restart_count * sizeof(uint32_t) +
+            header.block_count * handle_size + header.dict_size + header.range_deletion_size + header.key_size;
+        for (uint64_t size: {header.index_size, header.restart_count, header.block_count, header.dict_size,
+            header.range_deletion_size, header.key_size, meta_size + sizeof(fixed)}) {
+            if (size > file_size) {
+                printf("Error: malformed sstable %s.\n", filename.c_str());
+                return -1;
+            }
+        }
+        std::string meta(meta_size + sizeof(fixed) - sizeof(header.checksum), '\0');
+        if (!file.seekg(file_size - meta.size() - sizeof(header.checksum)) || !file.read(meta.data(), meta.size())) {
+            printf("Error: read sstable %s failed.\n", filename.c_str());
+            return -1;
+        }
+        if (Crc32c::value(meta.data(), meta.size()) != header.checksum) {
+            printf("Error: checksum mismatch in sstable %s.\n", filename.c_str());
+            return -1;
+        }
+
+        p = meta.data();
+        for (size_t i = 0; i < bloom_filter.bit_array.size(); i++)
+            bloom_filter.bit_array[i] = (p[i / 8] >> (8 - i % 8 - 1)) & 1;
+        p += bloom_size;
+        std::string index_data(p, header.index_size);
+        p += header.index_size;
+        vector<uint32_t> restarts(header.restart_count);
+        memcpy(restarts.data(), p, restarts.size() * sizeof(uint32_t));
+        p += restarts.size() * sizeof(uint32_t);
+        if (index.load(std::move(index_data), std::move(restarts), header.kv_count))
+            return -1;
+        blocks.clear();
+        for (uint64_t i = 0; i < header.block_count; i++) {
+            uint64_t fields[3];
+            memcpy(fields, p, handle_size);
+            p += handle_size;
+            blocks.emplace_back(fields[0], fields[1], fields[2]);
+            // blocks hold increasing ranges of the data and lie within the file, so getBlockDataSize is their size
+            const BlockHandle& block = blocks.back();
+            if ((i > 0 && block.data_offset <= blocks[i - 1].data_offset) || block.data_offset >= header.data_size ||
+                block.file_offset > file_size || file_size - block.file_offset < BlockHandle::kTrailerSize ||
+                block.size > file_size - block.file_offset - BlockHandle::kTrailerSize) {
+                printf("Error: malformed block %llu in sstable %s.\n", static_cast<unsigned long long>(i), filename.c_str());
+                return -1;
+            }
+        }
+        if (header.dict_size > 0)
+            compression_dict = std::make_shared<const CompressionDict>(std::string(p, header.dict_size));
+        p += header.dict_size;
+
+        const char* limit = p + header.range_deletion_size;
+        while (p != nullptr && p < limit) {
+            KType begin, end;
+            uint64_t count = 0, sequence = 0;
+            p = KeyCodec<KType>::get(p, limit, begin);
+            p = p == nullptr ? nullptr : KeyCodec<KType>::get(p, limit, end);
+            p = p == nullptr ? nullptr : Varint::get(p, limit, count);
+            for (uint64_t i = 0; p != nullptr && i < count; i++) {
+                p = Varint::get(p, limit, sequence);
+                if (p != nullptr)
+                    range_tombstones.add(begin, end, sequence);
+            }
         }
-        for(auto index: index) {
-            ofs.write(reinterpret_cast<const char*>(&index.key), sizeof(index.key));
-            ofs.write(reinterpret_cast<const char*>(&index.offset), sizeof(index.offset));
+        limit += header.key_size;
+        p = p == nullptr ? nullptr : KeyCodec<KType>::get(p, limit, header.min_key);
+        p = p == nullptr ? nullptr : KeyCodec<KType>::get(p, limit, header.max_key);
+        if (p == nullptr) {
+            printf("Error: malformed sstable %s.\n", filename.c_str());
+            return -1;
         }
+        return 0;
     }
 
 };
\ No newline at end of file
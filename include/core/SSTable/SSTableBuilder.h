@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include "SSTable.h"
+#include "FileWriter.h"
+#include "Compression.h"
+#include "SerializeWrapper.h"
+#include "BlobFile.h"
+
+struct SSTableBuilderOptions {
+    FileWriterOptions file_writer_options;
+    // uncompressed bytes of entries per data block, an entry never spans two blocks
+    uint64_t block_size{4096};
+    CompressionType compression{CompressionType::NONE};
+    // zstd only: max bytes of a dictionary trained from the values of the file, 0 disables it
+    uint64_t max_dict_bytes{0};
+    // zstd only: uncompressed bytes of blocks buffered as training samples before the
+    // dictionary is trained and the blocks are written
+    uint64_t max_train_bytes{1024 * 1024};
+    // build a learned model of the index predicting restart points within this error, 0 disables it
+    size_t learned_index_error_bound{0};
+    // keep a copy of the restart keys of the index in Eytzinger layout for faster lookups
+    bool use_eytzinger_index{false};
+};
+
+// Builds an sstable file in a single pass over kv-pairs added in key order:
+// values are buffered into blocks that are compressed and streamed to the file when full,
+// bloom filter, index, block handles and header are written after them by finish.
+// With a zstd dictionary, the first blocks are held back until the dictionary is
+// trained from their values.
+template<typename KType, typename VType>
+class SSTableBuilder {
+    private:
+        // a compressed block is only kept if it saves at least 1/kMinCompressionRatio of the block
+        static constexpr uint64_t kMinCompressionRatio = 8;
+
+        SSTableBuilderOptions options;
+        FileWriter writer;
+        SSTable<KType, VType> sstable;
+        std::string block;
+        std::string compressed_block;
+        // uncompressed bytes of values added so far
+        uint64_t data_offset{0};
+        // blocks are held back in buffered_data until the dictionary is trained
+        bool buffered{false};
+        std::string buffered_data;
+        // offsets of the ends of the held back blocks in buffered_data
+        vector<uint64_t> buffered_block_ends;
+
+        // compress the block of values starting at data_offset_ and append it with its trailer
+        int writeBlock(const char* data, size_t size, uint64_t data_offset_) {
+            CompressionType type = options.compression;
+            const char* output = nullptr;
+            size_t output_size = 0;
+            if (type != CompressionType::NONE &&
+                Compression::compress(type, data, size, compressed_block, sstable.compression_dict.get()) &&
+                compressed_block.size() <= size - size / kMinCompressionRatio) {
+                output = compressed_block.data();
+                output_size = compressed_block.size();
+            } else {
+                type = CompressionType::NONE;
+                output = data;
+                output_size = size;
+            }
+            sstable.blocks.emplace_back(writer.get_file_size(), output_size, data_offset_);
+            auto type_byte = static_cast<char>(type);
+            uint32_t checksum = Crc32c::extend(Crc32c::value(output, output_size), &type_byte, 1);
+            if (writer.append(output, output_size) || writer.append(type_byte) || writer.append(checksum)) {
+                return -1;
+            }
+            return 0;
+        }
+
+        int flushBlock() {
+            if (buffered) {
+                buffered_data.append(block);
+                buffered_block_ends.push_back(buffered_data.size());
+                block.clear();
+                return buffered_data.size() >= options.max_train_bytes ? leaveBuffered() : 0;
+            }
+            if (writeBlock(block.data(), block.size(), data_offset - block.size())) {
+                return -1;
+            }
+            block.clear();
+            return 0;
+        }
+
+        // train the dictionary with the held back values as samples, then write their blocks.
+        // The held back blocks are the first ones of the file and hold every value added so far
+        int leaveBuffered() {
+            buffered = false;
+            vector<size_t> sample_sizes;
+            for (auto iter = sstable.index.begin(); iter.valid(); iter.next()) {
+                sample_sizes.push_back(iter.get_entry().size);
+            }
+            std::string dict = CompressionDict::train(buffered_data, sample_sizes, options.max_dict_bytes);
+            if (!dict.empty()) {
+                sstable.header.dict_size = dict.size();
+                sstable.compression_dict = std::make_shared<const CompressionDict>(std::move(dict));
+            }
+
+            uint64_t block_begin = 0;
+            for (uint64_t block_end: buffered_block_ends) {
+                if (writeBlock(buffered_data.data() + block_begin, block_end - block_begin, block_begin)) {
+                    return -1;
+                }
+                block_begin = block_end;
+            }
+            buffered_data.clear();
+            buffered_data.shrink_to_fit();
+            buffered_block_ends.clear();
+            return 0;
+        }
+
+        // record an entry of key with a payload of payload_size bytes, returns where the payload goes in the block.
+        // An entry is its type, the varint sequence number and the payload.
+        // finishEntry must be called once the payload is written
+        char* reserveEntry(const KType& key, EntryType type, uint64_t sequence, size_t payload_size) {
+            if (sstable.header.kv_count == 0) {
+                sstable.header.min_key = key;
+            }
+            sstable.header.max_key = key;
+            sstable.header.max_sequence = std::max(sstable.header.max_sequence, sequence);
+            sstable.header.kv_count++;
+            sstable.bloom_filter.put(key);
+            size_t entry_size = 1 + Varint::length(sequence) + payload_size;
+            sstable.index.add(key, data_offset, entry_size);
+            size_t begin = block.size();
+            block.resize(begin + entry_size);
+            block[begin] = static_cast<char>(type);
+            char* payload = Varint::put(block.data() + begin + 1, sequence);
+            data_offset += entry_size;
+            return payload;
+        }
+
+        int finishEntry() {
+            if (block.size() >= options.block_size) {
+                return flushBlock();
+            }
+            return 0;
+        }
+    public:
+        explicit SSTableBuilder(const SSTableBuilderOptions& options_ = SSTableBuilderOptions()):
+            options(options_), writer(options_.file_writer_options) {}
+
+        int open(const std::string& filename, uint32_t level, uint32_t order, uint64_t timestamp) {
+            sstable.level = level;
+            sstable.order = order;
+            sstable.header.timestamp = timestamp;
+            sstable.header.max_sequence = 0;
+            sstable.header.kv_count = 0;
+            sstable.header.dict_size = 0;
+            buffered = options.compression == CompressionType::ZSTD && options.max_dict_bytes > 0 &&
+                Compression::isSupported(CompressionType::ZSTD);
+            return writer.open(filename);
+        }
+
+        // keys must be added in increasing order, the versions of a key newest first.
+        // sequence is the sequence number of the write, 0 for entries older than all writes
+        int addEntry(const KType& key, EntryType type, std::string_view payload, uint64_t sequence = 0) {
+            memcpy(reserveEntry(key, type, sequence, payload.size()), payload.data(), payload.size());
+            return finishEntry();
+        }
+
+        // the value (or merge operand) is serialized straight into the block
+        int add(const KType& key, const VType& value, EntryType type = EntryType::VALUE, uint64_t sequence = 0) {
+            size_t size = SerializeWrapper<VType>::serialize_size(value);
+            SerializeWrapper<VType>::serialize_to(value, std::span<char>(reserveEntry(key, type, sequence, size), size));
+            return finishEntry();
+        }
+
+        // an EXPIRING_VALUE entry, the value is serialized straight into the block after its expire time
+        int addExpiringValue(const KType& key, const VType& value, uint64_t expire_time, uint64_t sequence = 0) {
+            size_t size = SerializeWrapper<VType>::serialize_size(value);
+            char* dst = reserveEntry(key, EntryType::EXPIRING_VALUE, sequence, ExpiringValue::kExpireTimeSize + size);
+            ExpiringValue::putExpireTime(dst, expire_time);
+            SerializeWrapper<VType>::serialize_to(value, std::span<char>(dst + ExpiringValue::kExpireTimeSize, size));
+            return finishEntry();
+        }
+
+        // delete the versions of the keys in [begin, end) older than sequence, in this and older sstables
+        void addRangeTombstone(const KType& begin, const KType& end, uint64_t sequence = 0) {
+            sstable.range_tombstones.add(begin, end, sequence);
+            sstable.header.max_sequence = std::max(sstable.header.max_sequence, sequence);
+        }
+
+        int addBlobIndex(const KType& key, const BlobIndex& blob_index, uint64_t sequence = 0) {
+            sstable.blob_bytes[blob_index.file_number] += blob_index.size;
+            return addEntry(key, EntryType::BLOB_INDEX, blob_index.encode(), sequence);
+        }
+
+        // write the last block, bloom filter, index, block handles and header, then sync and close the file
+        int finish() {
+            if (!block.empty() && flushBlock()) {
+                return -1;
+            }
+            if (buffered && leaveBuffered()) {
+                return -1;
+            }
+            if (options.learned_index_error_bound > 0) {
+                sstable.index.buildLearnedIndex(options.learned_index_error_bound);
+            }
+            if (options.use_eytzinger_index) {
+                sstable.index.buildEytzingerLayout();
+            }
+            if (!sstable.range_tombstones.empty()) {
+                const KType& begin = sstable.range_tombstones.begin()->first;
+                const KType& end = std::prev(sstable.range_tombstones.end())->second.end;
+                if (sstable.header.kv_count == 0 || begin < sstable.header.min_key) {
+                    sstable.header.min_key = begin;
+                }
+                if (sstable.header.kv_count == 0 || sstable.header.max_key < end) {
+                    sstable.header.max_key = end;
+                }
+            }
+            sstable.header.data_size = data_offset;
+            sstable.header.block_count = sstable.blocks.size();
+            if (sstable.writeToFile(writer) || writer.close()) {
+                return -1;
+            }
+            sstable.file_size = writer.get_file_size();
+            return 0;
+        }
+
+        uint64_t get_kv_count() const {
+            return sstable.header.kv_count;
+        }
+
+        // bytes written so far, including the blocks not yet compressed
+        uint64_t get_file_size() const {
+            return writer.get_file_size() + buffered_data.size() + block.size();
+        }
+
+        // the sstable built, valid after finish
+        SSTable<KType, VType>& get_sstable() {
+            return sstable;
+        }
+};
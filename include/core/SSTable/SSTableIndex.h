@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Varint.h"
+#include "KeyCodec.h"
+#include "LearnedIndex.h"
+#include "EytzingerLayout.h"
+
+// Index of the entries of an sstable, kept in memory in the same compact form it has on disk.
+// Entries are added in key order, each one as its key encoded against the key before (see KeyCodec)
+// and a varint of its size, the offset follows from the entry before. Every kRestartInterval-th entry
+// is a restart point that stores its key and offset in full, lookups binary search the restart points
+// and then decode at most kRestartInterval entries. The restart keys of fixed width keys can also be
+// searched through a learned model of them, or through a copy of them in Eytzinger layout.
+template<typename KType>
+class SSTableIndex {
+    public:
+        static constexpr size_t kRestartInterval = 16;
+
+        using Codec = KeyCodec<KType>;
+
+        struct Entry {
+            KType key;
+            // offset and size of the entry in the uncompressed data
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        class Iterator {
+            private:
+                const SSTableIndex* index;
+                size_t position;
+                const char* p;
+                Entry entry{KType(), 0, 0};
+
+                void decode() {
+                    if (position < index->count) {
+                        p = index->decodeEntry(p, position % kRestartInterval == 0, entry);
+                        if (p == nullptr) {
+                            printf("Error: malformed sstable index.\n");
+                            position = index->count;
+                        }
+                    }
+                }
+            public:
+                // position at the restart point restart
+                Iterator(const SSTableIndex* index_, size_t restart):
+                    index(index_), position(restart * kRestartInterval),
+                    p(restart < index_->restarts.size() ? index_->data.data() + index_->restarts[restart] : nullptr) {
+                    decode();
+                }
+
+                bool valid() const {
+                    return position < index->count;
+                }
+
+                void next() {
+                    position++;
+                    decode();
+                }
+
+                size_t get_position() const {
+                    return position;
+                }
+
+                const Entry& get_entry() const {
+                    return entry;
+                }
+        };
+    private:
+        std::string data;
+        // offsets of the restart points in data
+        std::vector<uint32_t> restarts;
+        size_t count{0};
+        Entry last{KType(), 0, 0};
+        // predicts the restart point of a key, shared by copies of the index
+        std::shared_ptr<const PiecewiseLinearModel> model;
+        // the restart keys in Eytzinger layout, shared by copies of the index
+        std::shared_ptr<const EytzingerLayout> eytzinger_layout;
+
+        // restart keys mapped to uint64_t in key order, only for fixed width keys
+        std::vector<uint64_t> getRestartKeys() const {
+            std::vector<uint64_t> restart_keys;
+            for (size_t i = 0; i < restarts.size(); i++) {
+                restart_keys.push_back(Codec::toOrdered(getRestartKey(i)));
+            }
+            return restart_keys;
+        }
+
+        // the first restart point whose key is not less than key
+        size_t findRestart(const KType& key) const {
+            if constexpr (Codec::kFixedWidth) {
+                if (eytzinger_layout != nullptr) {
+                    return eytzinger_layout->lowerBound(Codec::toOrdered(key));
+                }
+            }
+            size_t l = 0, r = restarts.size();
+            if constexpr (Codec::kFixedWidth) {
+                if (model != nullptr) {
+                    auto [first, last] = model->predict(Codec::toOrdered(key));
+                    // the prediction is only used if the restart point is within it
+                    if ((first == 0 || getRestartKey(first - 1) < key) && (last == restarts.size() || !(getRestartKey(last) < key))) {
+                        l = first;
+                        r = last;
+                    }
+                }
+            }
+            while (l < r) {
+                size_t m = l + (r - l) / 2;
+                if (getRestartKey(m) < key) {
+                    l = m + 1;
+                } else {
+                    r = m;
+                }
+            }
+            return l;
+        }
+
+        // decode the entry at p, the entry before it if p is not a restart point
+        const char* decodeEntry(const char* p, bool restart, Entry& entry) const {
+            const char* limit = data.data() + data.size();
+            p = Codec::getIndexKey(p, limit, restart, entry.key);
+            if (restart) {
+                p = p == nullptr ? nullptr : Varint::get(p, limit, entry.offset);
+            } else {
+                entry.offset += entry.size;
+            }
+            return p == nullptr ? nullptr : Varint::get(p, limit, entry.size);
+        }
+
+    public:
+        // key of the restart point restart, every kRestartInterval-th key
+        KType getRestartKey(size_t restart) const {
+            KType key{};
+            Codec::getIndexKey(data.data() + restarts[restart], data.data() + data.size(), true, key);
+            return key;
+        }
+
+        // entries must be added in key order and be contiguous
+        void add(const KType& key, uint64_t offset, uint64_t size) {
+            if (count % kRestartInterval == 0) {
+                restarts.push_back(data.size());
+                Codec::putIndexKey(data, key, nullptr);
+                Varint::put(data, offset);
+            } else {
+                Codec::putIndexKey(data, key, &last.key);
+            }
+            Varint::put(data, size);
+            last = Entry{key, offset, size};
+            count++;
+        }
+
+        // restore an index of count entries from the encoded entries and restart points written to a file
+        int load(std::string data_, std::vector<uint32_t> restarts_, size_t count_) {
+            if (restarts_.size() != (count_ + kRestartInterval - 1) / kRestartInterval ||
+                std::any_of(restarts_.begin(), restarts_.end(), [&data_](uint32_t restart) { return restart >= data_.size(); })) {
+                printf("Error: malformed sstable index.\n");
+                return -1;
+            }
+            data = std::move(data_);
+            restarts = std::move(restarts_);
+            count = count_;
+            return 0;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        Iterator begin() const {
+            return Iterator(this, 0);
+        }
+
+        // iterator at the first entry whose key is not less than key
+        Iterator lowerBound(const KType& key) const {
+            // the entry is in the restart interval before the restart point found or is the restart point itself
+            size_t restart = findRestart(key);
+            Iterator iter(this, restart == 0 ? 0 : restart - 1);
+            while (iter.valid() && iter.get_entry().key < key) {
+                iter.next();
+            }
+            return iter;
+        }
+
+        // encoded entries, they are written to the file followed by the restart points
+        const std::string& get_data() const {
+            return data;
+        }
+
+        const std::vector<uint32_t>& get_restarts() const {
+            return restarts;
+        }
+
+        // fit a learned model of the restart keys, predicting their position within error_bound.
+        // Variable length keys are always binary searched
+        void buildLearnedIndex(size_t error_bound) {
+            if constexpr (Codec::kFixedWidth) {
+                model = std::make_shared<const PiecewiseLinearModel>(getRestartKeys(), error_bound);
+            }
+        }
+
+        // copy the restart keys to an Eytzinger layout, it is searched instead of the learned model
+        void buildEytzingerLayout() {
+            if constexpr (Codec::kFixedWidth) {
+                eytzinger_layout = std::make_shared<const EytzingerLayout>(getRestartKeys());
+            }
+        }
+
+        const PiecewiseLinearModel* get_model() const {
+            return model.get();
+        }
+
+        uint64_t getMemoryUsage() const {
+            return data.capacity() + restarts.capacity() * sizeof(uint32_t) + (model ? model->getMemoryUsage() : 0) +
+                (eytzinger_layout ? eytzinger_layout->getMemoryUsage() : 0);
+        }
+};
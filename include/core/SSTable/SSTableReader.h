@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "SSTable.h"
+#include "Compression.h"
+#include "Crc32c.h"
+
+// Reads entries of an sstable file, decompressing the blocks that hold them.
+// The last block read is kept, so reading entries in order decompresses each block once,
+// and its checksum is only verified when it is read from the file.
+template<typename KType, typename VType>
+class SSTableReader {
+    private:
+        const SSTable<KType, VType>& sstable;
+        std::string filename;
+        std::ifstream file;
+        bool verify_checksums;
+        // blocks.size() if no block is cached
+        size_t cached_block;
+        std::string block;
+        std::string compressed_block;
+
+        int readBlock(size_t block_id) {
+            if (block_id == cached_block) {
+                return 0;
+            }
+            const BlockHandle& handle = sstable.blocks[block_id];
+            // read the block with its trailer
+            compressed_block.resize(handle.size + BlockHandle::kTrailerSize);
+            file.seekg(handle.file_offset);
+            if (!file.read(compressed_block.data(), compressed_block.size())) {
+                printf("Error: read block %zu of %s failed.\n", block_id, filename.c_str());
+                file.clear();
+                return -1;
+            }
+            if (verify_checksums) {
+                uint32_t checksum;
+                memcpy(&checksum, compressed_block.data() + handle.size + 1, sizeof(checksum));
+                if (Crc32c::value(compressed_block.data(), handle.size + 1) != checksum) {
+                    printf("Error: checksum mismatch in block %zu of %s.\n", block_id, filename.c_str());
+                    return -1;
+                }
+            }
+            auto type = static_cast<CompressionType>(compressed_block[handle.size]);
+            if (!Compression::uncompress(type, compressed_block.data(), handle.size, sstable.getBlockDataSize(block_id), block,
+                sstable.compression_dict.get())) {
+                printf("Error: uncompress block %zu of %s failed.\n", block_id, filename.c_str());
+                cached_block = sstable.blocks.size();
+                return -1;
+            }
+            cached_block = block_id;
+            return 0;
+        }
+    public:
+        SSTableReader(const SSTable<KType, VType>& sstable_, const std::string& filename_, bool verify_checksums_ = true):
+            sstable(sstable_), filename(filename_), file(filename_, std::ios::binary | std::ios::in),
+            verify_checksums(verify_checksums_), cached_block(sstable_.blocks.size()) {}
+
+        // read an entry of the index, payload is the serialized value or the BlobIndex
+        // and sequence the sequence number of the write
+        // an entry the index places outside its block is rejected, the checksums don't catch a file written that way
+        int read(const typename SSTableIndex<KType>::Entry& entry, EntryType& type, uint64_t& sequence, std::string& payload) {
+            if (sstable.blocks.empty() || entry.offset < sstable.blocks[0].data_offset || entry.size == 0) {
+                printf("Error: entry at offset %llu of %s is outside the blocks.\n", static_cast<unsigned long long>(entry.offset), filename.c_str());
+                return -1;
+            }
+            size_t block_id = sstable.findBlock(entry.offset);
+            if (readBlock(block_id)) {
+                return -1;
+            }
+            uint64_t block_offset = entry.offset - sstable.blocks[block_id].data_offset;
+            if (block_offset > block.size() || entry.size > block.size() - block_offset) {
+                printf("Error: entry at offset %llu of %s is past the end of block %zu.\n", static_cast<unsigned long long>(entry.offset),
+                    filename.c_str(), block_id);
+                return -1;
+            }
+            const char* p = block.data() + block_offset;
+            const char* limit = p + entry.size;
+            type = static_cast<EntryType>(*p);
+            p = Varint::get(p + 1, limit, sequence);
+            if (p == nullptr) {
+                printf("Error: corrupted entry in %s.\n", filename.c_str());
+                return -1;
+            }
+            if (sstable.global_sequence != 0) {
+                sequence = sstable.global_sequence;
+            }
+            payload.assign(p, limit - p);
+            return 0;
+        }
+
+        int read(const typename SSTableIndex<KType>::Entry& entry, EntryType& type, std::string& payload) {
+            uint64_t sequence;
+            return read(entry, type, sequence, payload);
+        }
+};
@@ -1,8 +1,17 @@
 #pragma once
 
 #include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "SSTableReader.h"
+#include "BlobFile.h"
 #include "MemTable.h"
 #include "SerializeWrapper.h"
+#include "KVStoreOptions.h"
+#include "MergeOperator.h"
+#include "Snapshot.h"
+#include "WriteController.h"
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <format>
@@ -13,34 +22,83 @@
 #include <filesystem>
 #include <regex>
 #include <map>
+#include <queue>
+#include <set>
 #include <shared_mutex>
+#include <sstream>
 
 template<typename KType, typename VType>
 class KVStore {
 private:
-    uint64_t curr_timestamp;
-    uint64_t max_memtable_size;
+    std::atomic<uint64_t> curr_timestamp;
+    // sstable files are named {level}-{file number}.sst
+    std::atomic<uint32_t> next_file_number;
+    // sequence number of the last write, every write takes the next one under rw_mutex
+    std::atomic<uint64_t> last_sequence{0};
+    // sequence numbers of the live snapshots
+    std::multiset<uint64_t> snapshots;
+    std::mutex snapshot_mutex;
     string db_path;
+    KVStoreOptions options;
+    // folds the operands of merge, may be null if merge is not used
+    shared_ptr<const MergeOperator<VType>> merge_operator;
 
     shared_ptr<MemTable<KType, VType>> mem_table;
     shared_ptr<MemTable<KType, VType>> immutable_mem_table;
-    vector<vector<SSTable<KType, VType>>> sstables;
+    vector<vector<shared_ptr<SSTable<KType, VType>>>> sstables;
+    // blob files by file number, they are named {file number}.blob
+    std::map<uint64_t, BlobFileMeta> blob_files;
 
     std::condition_variable compaction_cv;
 
+    // a memtable is being flushed
     bool isCompaction{false};
+    // the last flush failed, its immutable memtable is kept until a flush succeeds
+    bool flush_failed{false};
+    // a major compaction is running, memtables can still be flushed meanwhile
+    bool isMajorCompaction{false};
+    // the store is being destroyed, no compaction is started anymore
+    bool closing{false};
+    // result of the last major compaction, returned to the writers it stopped
+    int background_error{0};
     std::mutex compaction_mutex;
 
     mutable std::shared_mutex rw_mutex;
+
+    uint64_t write_buffer_owner_id{0};
+    // -1 if the store failed to open, see get_status
+    int status{0};
+
+    WriteController write_controller;
+    // updated whenever the sstables change, writers wait on compaction_cv while STOPPED
+    std::atomic<WriteStallCondition> write_stall_condition{WriteStallCondition::NORMAL};
 private:
-    void compaction() {
+    // switch the memtable and flush it in background,
+    // force flushes a non-empty memtable even if it is below write_buffer_size
+    void compaction(bool force = false) {
         std::unique_lock guard(compaction_mutex);
        // std::cout <<"compaction, get compaction_mutex" << std::endl;
         compaction_cv.wait(guard, [this]() { return !isCompaction; });
+        // the write buffer manager may still ask a store being destroyed to flush
+        if (closing) {
+            return;
+        }
 
+        std::unique_lock rw_lock(rw_mutex);
+        // an immutable memtable left by a failed flush is flushed again before the memtable is switched
+        if (immutable_mem_table == nullptr) {
+            // another writer may have switched the memtable while we were waiting
+            if (mem_table -> get_size() == 0 || (!force && mem_table -> get_memory_usage() < options.write_buffer_size)) {
+                return;
+            }
+            if (options.write_buffer_manager) {
+                options.write_buffer_manager -> scheduleFreeMem(write_buffer_owner_id, mem_table -> get_memory_usage());
+            }
+            immutable_mem_table = std::move(mem_table);
+            mem_table = make_shared<MemTable<KType, VType>>();
+        }
         isCompaction = true;
-        immutable_mem_table = std::move(mem_table);
-        mem_table = make_shared<MemTable<KType, VType>>();
+        rw_lock.unlock();
 
         std::thread bg(std::bind(&KVStore<KType, VType>::doCompaction, this));
         bg.detach();
@@ -50,262 +108,1283 @@ private:
 
     void doCompaction() {
         std::unique_lock<std::mutex> guard(compaction_mutex);
-        minorCompaction();
-        if (sstables[0].size() >= 8) {
-            max_memtable_size  *= 2;
-            majorCompaction();
-        }
+        flush_failed = minorCompaction() != 0;
+        maybeScheduleMajorCompaction();
         isCompaction = false;
-        guard.unlock();
+        // notify with compaction_mutex held, the destructor may be waiting to destroy compaction_cv
+        compaction_cv.notify_all();
+    }
+
+    // start a major compaction in background if level 0 has enough sstables,
+    // compaction_mutex must be held
+    void maybeScheduleMajorCompaction() {
+        if (isMajorCompaction) {
+            return;
+        }
+        {
+            std::shared_lock rw_lock(rw_mutex);
+            if (sstables[0].size() < options.level0_file_num_compaction_trigger) {
+                return;
+            }
+        }
+        isMajorCompaction = true;
+        std::thread bg(std::bind(&KVStore<KType, VType>::doMajorCompaction, this));
+        bg.detach();
+    }
+
+    void doMajorCompaction() {
+        int result = majorCompaction();
+        std::unique_lock<std::mutex> guard(compaction_mutex);
+        isMajorCompaction = false;
+        background_error = result;
+        // level 0 may have filled up again while compacting, a failed compaction is retried
+        // after the next flush or by the next stopped write
+        if (result == 0) {
+            maybeScheduleMajorCompaction();
+        }
         compaction_cv.notify_all();
     }
 
+    // bytes major compaction still has to rewrite
+    uint64_t estimatePendingCompactionBytes() const {
+        if (sstables[0].size() < options.level0_file_num_compaction_trigger) {
+            return 0;
+        }
+        uint64_t pending_compaction_bytes = 0;
+        for (size_t level = 0; level < 2; level++) {
+            for (const auto& sstable: sstables[level]) {
+                pending_compaction_bytes += sstable->file_size;
+            }
+        }
+        return pending_compaction_bytes;
+    }
+
+    // rw_mutex must be held
+    void updateWriteStallCondition() {
+        uint64_t level0_file_num = sstables[0].size();
+        uint64_t pending_compaction_bytes = estimatePendingCompactionBytes();
+        if (level0_file_num >= options.level0_stop_writes_trigger ||
+            pending_compaction_bytes >= options.hard_pending_compaction_bytes_limit) {
+            write_stall_condition = WriteStallCondition::STOPPED;
+        } else if (level0_file_num >= options.level0_slowdown_writes_trigger ||
+            pending_compaction_bytes >= options.soft_pending_compaction_bytes_limit) {
+            write_stall_condition = WriteStallCondition::DELAYED;
+        } else {
+            write_stall_condition = WriteStallCondition::NORMAL;
+        }
+    }
+
+    // block or slow down a write of bytes while compaction is behind. Returns -1 if writes
+    // are stopped and the major compaction that would resume them failed
+    int delayWrite(uint64_t bytes) {
+        if (write_stall_condition == WriteStallCondition::STOPPED) {
+            std::unique_lock guard(compaction_mutex);
+            while (write_stall_condition == WriteStallCondition::STOPPED) {
+                // retries a major compaction that failed
+                maybeScheduleMajorCompaction();
+                if (!isMajorCompaction) {
+                    printf("Error: writes stopped, but no major compaction can run.\n");
+                    return -1;
+                }
+                compaction_cv.wait(guard, [this]() {
+                    return write_stall_condition != WriteStallCondition::STOPPED || !isMajorCompaction;
+                });
+                if (write_stall_condition == WriteStallCondition::STOPPED && background_error) {
+                    printf("Error: writes stopped, major compaction failed.\n");
+                    return background_error;
+                }
+            }
+        }
+        if (write_stall_condition == WriteStallCondition::DELAYED) {
+            uint64_t delay = write_controller.getDelay(bytes);
+            if (delay > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(delay));
+            }
+        }
+        return 0;
+    }
+
+    // sequence numbers of the live snapshots, in increasing order
+    vector<uint64_t> getSnapshotSequences() {
+        std::lock_guard guard(snapshot_mutex);
+        return vector<uint64_t>(snapshots.begin(), snapshots.end());
+    }
+
+    // Snapshots split the versions of a key into stripes: the versions newer than one snapshot and
+    // not newer than the next are read by the same snapshots, so only the newest of them is ever read,
+    // the others can be dropped. The versions newer than all snapshots are the last stripe
+    static size_t getSnapshotStripe(const vector<uint64_t>& snapshot_sequences, uint64_t sequence) {
+        return std::lower_bound(snapshot_sequences.begin(), snapshot_sequences.end(), sequence) - snapshot_sequences.begin();
+    }
+
+    // wall clock time expire times are measured in
+    static uint64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
 public:
-    KVStore(const string& db_path_): curr_timestamp(0), max_memtable_size(64), db_path(db_path_), mem_table(make_shared<MemTable<KType, VType>>()), immutable_mem_table(nullptr), sstables(1) {
-        if (!std::filesystem::exists(db_path)) {
+    KVStore(const string& db_path_, const KVStoreOptions& options_ = KVStoreOptions(), shared_ptr<const MergeOperator<VType>> merge_operator_ = nullptr): curr_timestamp(0), next_file_number(0), db_path(db_path_), options(options_), merge_operator(std::move(merge_operator_)), mem_table(make_shared<MemTable<KType, VType>>()), immutable_mem_table(nullptr), sstables(2), write_controller(options_.delayed_write_rate) {
+        if (options.validate()) {
+            status = -1;
+        } else if (!std::filesystem::exists(db_path)) {
             std::filesystem::create_directory(db_path);
+        } else if (std::filesystem::exists(getManifestPath(db_path))) {
+            status = recover();
+        }
+        if (options.write_buffer_manager) {
+            write_buffer_owner_id = options.write_buffer_manager -> registerOwner([this]() { compaction(true); });
+        }
+        if (status == 0) {
+            // level 0 may have been left over the trigger
+            std::lock_guard guard(compaction_mutex);
+            maybeScheduleMajorCompaction();
+        }
+    }
+
+    // 0 if the store opened, -1 if its options are invalid or its manifest lists a file that can't be read. Such a store
+    // holds none of its files and never rewrites its manifest, it must not be used
+    int get_status() const {
+        return status;
+    }
+
+    // whether writes are delayed or stopped while compaction is behind, see delayWrite
+    WriteStallCondition get_write_stall_condition() const {
+        return write_stall_condition;
+    }
+
+    ~KVStore() {
+        std::unique_lock guard(compaction_mutex);
+        compaction_cv.wait(guard, [this]() { return !isCompaction && !isMajorCompaction; });
+        closing = true;
+        if (options.write_buffer_manager) {
+            options.write_buffer_manager -> scheduleFreeMem(write_buffer_owner_id, mem_table -> get_memory_usage());
+            options.write_buffer_manager -> freeMem(mem_table -> get_memory_usage());
+            // left by a failed flush
+            if (immutable_mem_table != nullptr) {
+                options.write_buffer_manager -> freeMem(immutable_mem_table -> get_memory_usage());
+            }
+        }
+        guard.unlock();
+        // waits for a flush callback that is running, it returns as the store is closing
+        if (options.write_buffer_manager) {
+            options.write_buffer_manager -> unregisterOwner(write_buffer_owner_id);
         }
     }
 
-    void put(const KType key, const VType value) {
+    // put, del, merge and deleteRange return -1 if writes are stopped and the major compaction
+    // that would resume them failed, see delayWrite
+    int put(const KType key, const VType value) {
+        if (options.default_ttl_ms > 0) {
+            return put(key, value, options.default_ttl_ms);
+        }
+        return write(key, value, EntryType::VALUE);
+    }
+
+    // the value expires ttl_ms after now, the key reads as deleted from then on.
+    // A ttl_ms past the end of time saturates, the value never expires
+    int put(const KType key, const VType value, uint64_t ttl_ms) {
+        uint64_t now = nowMs();
+        return write(key, value, EntryType::EXPIRING_VALUE, ttl_ms > UINT64_MAX - now ? UINT64_MAX : now + ttl_ms);
+    }
+
+    int del(const KType key) {
+        return write(key, VType(), EntryType::DELETION);
+    }
+
+    // apply operand to the value of key through the merge operator, the value is not read.
+    // Operands are kept until get or compaction find the value they apply to
+    int merge(const KType key, const VType operand) {
+        if (merge_operator == nullptr) {
+            printf("Error: merge without a merge operator.\n");
+            return -1;
+        }
+        if (delayWrite(KeyCodec<KType>::size(key) + SerializeWrapper<VType>::serialize_size(operand))) {
+            return -1;
+        }
+        std::unique_lock rw_lock(rw_mutex);
+        uint64_t memory_usage = mem_table -> get_memory_usage();
+        mem_table -> merge(++last_sequence, key, operand, [this](const VType& existing, const VType& operand) {
+            return merge_operator->merge(existing, operand);
+        }, nowMs());
+        afterWrite(rw_lock, memory_usage);
+        return 0;
+    }
+
+    // delete all keys in [begin, end) with a single range tombstone
+    int deleteRange(const KType& begin, const KType& end) {
+        if (delayWrite(KeyCodec<KType>::size(begin) + KeyCodec<KType>::size(end))) {
+            return -1;
+        }
+        std::unique_lock rw_lock(rw_mutex);
+        uint64_t memory_usage = mem_table -> get_memory_usage();
+        mem_table -> deleteRange(++last_sequence, begin, end);
+        afterWrite(rw_lock, memory_usage);
+        return 0;
+    }
+
+private:
+    // add a version of key to the memtable, expire_time is for EXPIRING_VALUE only
+    int write(const KType& key, const VType& value, EntryType type, uint64_t expire_time = 0) {
+        if (delayWrite(KeyCodec<KType>::size(key) + SerializeWrapper<VType>::serialize_size(value))) {
+            return -1;
+        }
         //std::cout<< "put, acquire for rw_lock" << std::endl;
         std::unique_lock rw_lock(rw_mutex);
         //std::cout<< "put, get rw_lock" << std::endl;
-        if(mem_table -> get(key) != nullptr)
-        {
-            mem_table -> put(key, value);
+        uint64_t memory_usage = mem_table -> get_memory_usage();
+        mem_table -> put(++last_sequence, key, value, type, expire_time);
+        afterWrite(rw_lock, memory_usage);
+        return 0;
+    }
+
+    // account the growth of the memtable from memory_usage bytes and flush it once it is full,
+    // rw_lock is released
+    void afterWrite(std::unique_lock<std::shared_mutex>& rw_lock, uint64_t memory_usage) {
+        if (options.write_buffer_manager) {
+            updateWriteBufferUsage(memory_usage, mem_table -> get_memory_usage());
         }
-        else
-        {
-            if(mem_table -> get_size() + 1 <= max_memtable_size)
+        if (mem_table -> get_memory_usage() >= options.write_buffer_size) {
+            rw_lock.unlock();
+            compaction();
+        } else if (options.write_buffer_manager && options.write_buffer_manager -> shouldFlush()) {
+            rw_lock.unlock();
+            options.write_buffer_manager -> maybeFlush();
+        }
+        //std::cout<< "put, release rw_lock" << std::endl;
+    }
+
+public:
+    // flush the memtables to level 0 and wait for it, returns -1 if a flush fails.
+    // An immutable memtable left by a failed flush is flushed before the memtable is switched, so
+    // the writes made before the call may take two flushes. Later writes may switch the memtable
+    // again, they are not waited for
+    int flush() {
+        for (int flushes = 0; flushes < 2; flushes++) {
             {
-                mem_table -> put(key, value);
+                std::shared_lock rw_lock(rw_mutex);
+                if (immutable_mem_table == nullptr && mem_table -> get_size() == 0) {
+                    break;
+                }
             }
-            else
-            {
-                if (mem_table -> get_size() + 1 >= max_memtable_size) {
-                    rw_lock.unlock();
-                    compaction();
-                    rw_lock.lock();
+            compaction(true);
+            std::unique_lock guard(compaction_mutex);
+            compaction_cv.wait(guard, [this]() { return !isCompaction; });
+            if (flush_failed) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    // write a copy of the store to dir, which must not exist yet, for a KVStore opened on dir.
+    // The memtables are flushed first, then the sstable and blob files are hard linked into dir
+    // (copied if dir is on another file system), so a checkpoint takes time in the number of
+    // files, not in their size. Writes made while it is created may be left out of it
+    int createCheckpoint(const string& dir) {
+        if (std::filesystem::exists(dir)) {
+            printf("Error: checkpoint directory %s already exists.\n", dir.c_str());
+            return -1;
+        }
+        if (flush()) {
+            printf("Error: flush for checkpoint %s failed.\n", dir.c_str());
+            return -1;
+        }
+        std::error_code ec;
+        int result = 0;
+        if (!std::filesystem::create_directories(dir, ec)) {
+            printf("Error: create checkpoint directory %s failed.\n", dir.c_str());
+            result = -1;
+        }
+        {
+            // files are only deleted with rw_mutex held exclusively
+            std::shared_lock rw_lock(rw_mutex);
+            for (const auto& sstable_level: sstables) {
+                for (const auto& sstable: sstable_level) {
+                    result = result || linkFile(getSSTablePath(sstable->level, sstable->order), dir);
                 }
-                mem_table -> put(key, value);
             }
+            for (const auto& [file_number, blob_file]: blob_files) {
+                result = result || linkFile(getBlobFilePath(file_number), dir);
+            }
+            result = result || writeManifest(dir);
         }
-        //std::cout<< "put, release rw_lock" << std::endl;
-        //std::cout << std::format("key: {}, value: {}, size: {}\n", key, value, mem_table.get_size());
+        // a partial checkpoint is not left behind
+        if (result) {
+            std::filesystem::remove_all(dir, ec);
+            return -1;
+        }
+        return 0;
     }
 
+    // Add an sstable file built by SstFileWriter to the store, its keys read as written after all
+    // writes before. The file is copied into the store and placed in level 1 if it overlaps no
+    // sstable, else in level 0 as the newest sstable. Memtables holding keys in its range are
+    // flushed first, as they are read before the sstables
+    int ingestExternalFile(const string& path) {
+        // copied rather than linked, the file may be rewritten by its writer
+        uint32_t order = next_file_number++;
+        string temp_path = getSSTableTempPath(0, order);
+        std::error_code ec;
+        std::filesystem::copy_file(path, temp_path, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            printf("Error: copy %s into the store failed.\n", path.c_str());
+            return -1;
+        }
+        auto sstable = make_shared<SSTable<KType, VType>>();
+        if (sstable->readFromFile(temp_path) || !isIngestible(*sstable, temp_path)) {
+            printf("Error: ingest %s failed.\n", path.c_str());
+            std::filesystem::remove(temp_path, ec);
+            return -1;
+        }
+        if (options.learned_index_error_bound > 0) {
+            sstable->index.buildLearnedIndex(options.learned_index_error_bound);
+        }
+        if (options.use_eytzinger_index) {
+            sstable->index.buildEytzingerLayout();
+        }
+        const KType& min_key = sstable->header.min_key;
+        const KType& max_key = sstable->header.max_key;
 
-    unique_ptr<VType> get(const KType key) {
-        std::shared_lock lock(rw_mutex);
-        unique_ptr<VType> val_ptr = mem_table -> get(key);
-        if(val_ptr){
-            if(*val_ptr == DeleteMarker<VType>::value())
-                return nullptr;
-            return val_ptr;
+        std::unique_lock rw_lock(rw_mutex);
+        while (mem_table->overlaps(min_key, max_key) ||
+            (immutable_mem_table != nullptr && immutable_mem_table->overlaps(min_key, max_key))) {
+            rw_lock.unlock();
+            compaction(true);
+            {
+                std::unique_lock guard(compaction_mutex);
+                compaction_cv.wait(guard, [this]() { return !isCompaction; });
+                if (flush_failed) {
+                    printf("Error: flush before ingesting %s failed.\n", path.c_str());
+                    std::filesystem::remove(temp_path, ec);
+                    return -1;
+                }
+            }
+            rw_lock.lock();
+        }
+        bool overlapping = false;
+        for (const auto& sstable_level: sstables) {
+            for (const auto& other: sstable_level) {
+                overlapping |= !(other->header.max_key < min_key) && !(max_key < other->header.min_key);
+            }
         }
+        sstable->level = overlapping ? 0 : 1;
+        sstable->order = order;
+        sstable->header.timestamp = ++curr_timestamp;
+        sstable->global_sequence = ++last_sequence;
+        std::filesystem::rename(temp_path, getSSTablePath(sstable->level, order), ec);
+        if (ec) {
+            printf("Error: ingest %s failed.\n", path.c_str());
+            std::filesystem::remove(temp_path, ec);
+            return -1;
+        }
+        auto old_sstables = sstables;
+        auto old_blob_files = blob_files;
+        sstables[sstable->level].push_back(sstable);
+        if (installChange(std::move(old_sstables), std::move(old_blob_files))) {
+            printf("Error: ingest %s failed.\n", path.c_str());
+            return -1;
+        }
+        rw_lock.unlock();
+
+        std::unique_lock guard(compaction_mutex);
+        maybeScheduleMajorCompaction();
+        return 0;
+    }
 
-        if (immutable_mem_table != nullptr) {
-            val_ptr = immutable_mem_table -> get(key);
-            if(val_ptr){
-                if(*val_ptr == DeleteMarker<VType>::value())
-                    return nullptr;
-                return val_ptr;
+    // the point in time of the writes made so far, see Snapshot
+    shared_ptr<const Snapshot> getSnapshot() {
+        std::lock_guard guard(snapshot_mutex);
+        uint64_t sequence = last_sequence;
+        snapshots.insert(sequence);
+        return shared_ptr<const Snapshot>(new Snapshot(sequence), [this](const Snapshot* snapshot) {
+            {
+                std::lock_guard guard(snapshot_mutex);
+                snapshots.erase(snapshots.find(snapshot->sequence));
+            }
+            delete snapshot;
+        });
+    }
+
+    // read key as of snapshot, or the latest value of key if snapshot is null.
+    // Null if key has no value or it can't be read, the overload below tells them apart
+    unique_ptr<VType> get(const KType key, const Snapshot* snapshot = nullptr) {
+        int result = 0;
+        return getValue(key, snapshot, result);
+    }
+
+    // set value to the value of key as get does, returns -1 if an entry of key or its blob can't be read
+    int get(const KType key, unique_ptr<VType>& value, const Snapshot* snapshot = nullptr) {
+        int result = 0;
+        value = getValue(key, snapshot, result);
+        return result;
+    }
+
+private:
+    // result is set to -1 if a version of key can't be read, the versions older than it
+    // are not read in its place
+    unique_ptr<VType> getValue(const KType& key, const Snapshot* snapshot, int& result) {
+        std::shared_lock lock(rw_mutex);
+        uint64_t sequence = snapshot == nullptr ? last_sequence.load() : snapshot->sequence;
+        // operands of merges newer than the value of key, newest first
+        vector<VType> operands;
+        uint64_t now = nowMs();
+        // the newest range tombstone covering key in the memtables and sstables read so far, versions
+        // older than it are deleted. They are read newest first, so its sstables only hold older versions
+        uint64_t range_deletion_sequence = 0;
+        for (auto* table: {mem_table.get(), immutable_mem_table.get()}) {
+            if (table == nullptr)
+                continue;
+            range_deletion_sequence = std::max(range_deletion_sequence, table -> getRangeDeletionSequence(key, sequence));
+            for (auto iter = table -> lowerBound(key, sequence); iter.valid() && iter.key().key == key; iter.next()) {
+                if (iter.key().sequence < range_deletion_sequence || iter.type() == EntryType::DELETION ||
+                    (iter.type() == EntryType::EXPIRING_VALUE && iter.expire_time() <= now))
+                    return applyMerge(nullptr, operands);
+                if (iter.type() != EntryType::MERGE)
+                    return applyMerge(make_unique<VType>(iter.value()), operands);
+                operands.push_back(iter.value());
             }
         }
 
-        uint64_t max_timestamp = 0;
+        // newest first: level 0 from the last sstable flushed, then level 1
         string value_str;
-        bool find_in_sstable = false;
-        for(auto& sstable_level:sstables)
-            for(auto &sstable:sstable_level) {
-                if(sstable.header.timestamp < max_timestamp)
+        EntryType type;
+        uint64_t entry_sequence;
+        for (auto& sstable_level: sstables)
+            for (auto iter = sstable_level.rbegin(); iter != sstable_level.rend(); ++iter) {
+                const auto& sstable = *iter;
+                range_deletion_sequence = std::max(range_deletion_sequence, sstable->range_tombstones.getSequence(key, sequence));
+                if (!sstable->bloom_filter.contains(key))
+                    continue;
+                auto index_iter = sstable->index.lowerBound(key);
+                if (!index_iter.valid() || !(index_iter.get_entry().key == key))
                     continue;
-                if(sstable.bloom_filter.contains(key)) {
-                    long l = 0, r = sstable.index.size() - 1;
-                    while(l <= r) {
-                        long m = l + (r - l) / 2;
-                        if(sstable.index[m].key == key) {
-                            std::ifstream sstable_file(std::format("{}/{}-{}.sst", db_path, sstable.level, sstable.order), std::ios::binary | std::ios::in);
-                            value_str = readFromSSTable(sstable, m, sstable_file);
-                            sstable_file.close();
-                            max_timestamp = sstable.header.timestamp;
-                            find_in_sstable = true;
-                            break;
-                        }
-                        if(sstable.index[m].key < key)
-                            l = m + 1;
-                        else
-                            r = m - 1;
+                SSTableReader<KType, VType> reader(*sstable, getSSTablePath(sstable->level, sstable->order), options.verify_checksums);
+                for (; index_iter.valid() && index_iter.get_entry().key == key; index_iter.next()) {
+                    if (reader.read(index_iter.get_entry(), type, entry_sequence, value_str)) {
+                        result = -1;
+                        return nullptr;
+                    } else if (entry_sequence > sequence) {
+                        // newer than the snapshot
+                    } else if (entry_sequence < range_deletion_sequence || type == EntryType::DELETION) {
+                        return applyMerge(nullptr, operands);
+                    } else if (type == EntryType::MERGE) {
+                        operands.push_back(SerializeWrapper<VType>::deserialize_from(value_str));
+                    } else if (type == EntryType::EXPIRING_VALUE) {
+                        if (ExpiringValue::getExpireTime(value_str) <= now)
+                            return applyMerge(nullptr, operands);
+                        return applyMerge(make_unique<VType>(SerializeWrapper<VType>::deserialize_from(ExpiringValue::getValue(value_str))), operands);
+                    } else if (type == EntryType::BLOB_INDEX && readBlob(value_str, value_str)) {
+                        result = -1;
+                        return nullptr;
+                    } else {
+                        return applyMerge(make_unique<VType>(SerializeWrapper<VType>::deserialize_from(value_str)), operands);
                     }
                 }
             }
-        if(find_in_sstable) {
-            if(DeleteMarker<VType>::isDeleted(SerializeWrapper<VType>::deserialize(value_str)))
-                return nullptr;
-            else
-                return make_unique<VType>(SerializeWrapper<VType>::deserialize(value_str));
+        return applyMerge(nullptr, operands);
+    }
+
+    // combine merge operands, newest first, with the value they apply to, which is null if there is none
+    unique_ptr<VType> applyMerge(unique_ptr<VType> value, vector<VType>& operands) const {
+        if (!operands.empty() && merge_operator == nullptr) {
+            printf("Error: merge operands found without a merge operator.\n");
+            return nullptr;
         }
-        return nullptr;
+        for (auto iter = operands.rbegin(); iter != operands.rend(); ++iter) {
+            value = make_unique<VType>(value ? merge_operator->merge(*value, *iter) : std::move(*iter));
+        }
+        return value;
     }
 
-    SSTable<KType, VType> writeImmutableToDisk() {
-        SSTable<KType, VType> sstable;
-        sstable.level = 0;
-        sstable.order = sstables[0].size();
-        sstable.header.timestamp = curr_timestamp;
-        sstable.header.kv_count = immutable_mem_table->get_size();
-        size_t offset = 0;
+    // serialized merge of an older value or operand with a newer operand
+    string mergePayloads(std::string_view existing, std::string_view operand) const {
+        if (merge_operator == nullptr) {
+            printf("Error: merge operands found without a merge operator.\n");
+            return string(operand);
+        }
+        return SerializeWrapper<VType>::serialize(merge_operator->merge(SerializeWrapper<VType>::deserialize_from(existing),
+            SerializeWrapper<VType>::deserialize_from(operand)));
+    }
 
-        if(immutable_mem_table->get_min_max_key(sstable.header.min_key, sstable.header.max_key))
-        {
-            printf("Error: get_min_max_key failed, because there is no node in memtable.\n");
+    // read the value a BlobIndex encoded in payload points to
+    int readBlob(const string& payload, string& value_str) const {
+        BlobIndex blob_index;
+        if (blob_index.decode(payload)) {
+            printf("Error: invalid blob index.\n");
+            return -1;
         }
+        return BlobFileReader::read(getBlobFilePath(blob_index.file_number), blob_index, value_str, options.verify_checksums);
+    }
 
-        sstable.bloom_filter = BloomFilter<KType>();
+    // add a serialized value to builder, values of at least min_blob_size bytes are
+    // separated into the blob file of blob_builder, which is opened on first use
+    int addValue(SSTableBuilder<KType, VType>& builder, unique_ptr<BlobFileBuilder<KType>>& blob_builder,
+        IOPriority priority, const KType& key, std::string_view value_str, uint64_t sequence) {
+        if (!options.enable_blob_files || value_str.size() < options.min_blob_size) {
+            return builder.addEntry(key, EntryType::VALUE, value_str, sequence);
+        }
+        return addBlob(builder, blob_builder, priority, key, value_str, sequence);
+    }
 
-        offset += sstable.header.getHeaderSpace() +
-            immutable_mem_table->get_size() * (sizeof(SSTableIndex::key) + sizeof(SSTableIndex::offset)) +
-            sstable.bloom_filter.bit_array.size() / 8 * sizeof(bool);
+    // add a value of the memtable to builder, inline values are serialized straight into the sstable
+    int addValue(SSTableBuilder<KType, VType>& builder, unique_ptr<BlobFileBuilder<KType>>& blob_builder,
+        IOPriority priority, const KType& key, const VType& value, uint64_t sequence) {
+        if (!options.enable_blob_files || SerializeWrapper<VType>::serialize_size(value) < options.min_blob_size) {
+            return builder.add(key, value, EntryType::VALUE, sequence);
+        }
+        return addBlob(builder, blob_builder, priority, key, SerializeWrapper<VType>::serialize(value), sequence);
+    }
 
-        for(auto kv_wrapper: immutable_mem_table->get_all_kv())
-        {
-            sstable.bloom_filter.put(*(kv_wrapper.key_ptr));
-            sstable.index.push_back(SSTableIndex(*(kv_wrapper.key_ptr), offset));
-            // std::cout << std::format("key: {}, value {},offset: {}\n", *(kv_wrapper.key_ptr), *(kv_wrapper.value_ptr) , offset);
-            offset += SerializeWrapper<VType>::serialize_size(*(kv_wrapper.value_ptr));
+    int addBlob(SSTableBuilder<KType, VType>& builder, unique_ptr<BlobFileBuilder<KType>>& blob_builder,
+        IOPriority priority, const KType& key, std::string_view value_str, uint64_t sequence) {
+        if (blob_builder == nullptr) {
+            uint64_t file_number = next_file_number++;
+            blob_builder = make_unique<BlobFileBuilder<KType>>(getFileWriterOptions(priority));
+            if (blob_builder->open(getBlobFilePath(file_number), file_number)) {
+                return -1;
+            }
+        }
+        BlobIndex blob_index;
+        if (blob_builder->add(key, value_str, blob_index)) {
+            return -1;
         }
+        return builder.addBlobIndex(key, blob_index, sequence);
+    }
 
-        string filename = std::format("{}/{}-{}.sst", db_path, sstable.level, sstable.order);
-        std::ofstream sstable_file(filename, std::ios::binary | std::ios::out);
-        // write metadata to file
-        sstable.writeToFile(sstable_file);
+    // finish the blob file of a flush or subcompaction, if any. It is added to new_blob_files
+    // even if that fails, so it is removed with the other outputs
+    int finishBlobFile(unique_ptr<BlobFileBuilder<KType>>& blob_builder, vector<BlobFileMeta>& new_blob_files) {
+        if (blob_builder == nullptr) {
+            return 0;
+        }
+        int result = blob_builder->finish();
+        if (result) {
+            printf("Error: write blob file %llu failed.\n", static_cast<unsigned long long>(blob_builder->get_meta().file_number));
+        }
+        new_blob_files.push_back(blob_builder->get_meta());
+        blob_builder.reset();
+        return result;
+    }
 
-        // write data to file
-        for(auto kv_wrapper: immutable_mem_table->get_all_kv()){
-            sstable_file.write(SerializeWrapper<VType>::serialize(*(kv_wrapper.value_ptr)).c_str(),
-            SerializeWrapper<VType>::serialize_size(*(kv_wrapper.value_ptr)));
+    // remove the files of a failed flush or compaction
+    void removeOutputs(const vector<string>& sstable_paths, const vector<BlobFileMeta>& new_blob_files) const {
+        std::error_code ec;
+        for (const auto& path: sstable_paths) {
+            std::filesystem::remove(path, ec);
+        }
+        for (const auto& blob_file: new_blob_files) {
+            std::filesystem::remove(getBlobFilePath(blob_file.file_number), ec);
         }
-        return sstable;
     }
 
-    void minorCompaction()
-    {
-        curr_timestamp++;
+    // write the immutable memtable to a level 0 sstable, nothing is left on disk if that fails
+    int writeImmutableToDisk(uint64_t timestamp, SSTable<KType, VType>& sstable, vector<BlobFileMeta>& new_blob_files) {
+        uint32_t order = next_file_number++;
+        string filename = getSSTablePath(0, order);
+        SSTableBuilder<KType, VType> builder(getSSTableBuilderOptions(0, IOPriority::HIGH));
+        unique_ptr<BlobFileBuilder<KType>> blob_builder;
+        int result = builder.open(filename, 0, order, timestamp);
+        uint64_t now = nowMs();
+        // snapshots taken from now on see all versions of the memtable
+        vector<uint64_t> snapshot_sequences = getSnapshotSequences();
+        // the version written last and its stripe
+        const KType* last_key = nullptr;
+        size_t last_stripe = 0;
+        EntryType last_type = EntryType::VALUE;
 
-        SSTable<KType, VType> sstable = writeImmutableToDisk();
+        // write values, then bloom filter, index and header to file
+        for (auto iter = immutable_mem_table->begin(); iter.valid() && !result; iter.next()) {
+            const auto& [key, sequence] = iter.key();
+            size_t stripe = getSnapshotStripe(snapshot_sequences, sequence);
+            // a newer version in the same stripe hides this one, unless it is a merge operand applied to it
+            if (last_key != nullptr && *last_key == key && stripe == last_stripe && last_type != EntryType::MERGE) {
+                continue;
+            }
+            last_key = &key;
+            last_stripe = stripe;
+            last_type = iter.type();
+            if (iter.type() == EntryType::DELETION) {
+                result = builder.addEntry(key, EntryType::DELETION, "", sequence);
+            } else if (iter.type() == EntryType::MERGE) {
+                result = builder.add(key, iter.value(), EntryType::MERGE, sequence);
+            } else if (iter.type() == EntryType::EXPIRING_VALUE) {
+                // an expired value only has to hide older values of its key
+                result = iter.expire_time() <= now ? builder.addEntry(key, EntryType::DELETION, "", sequence) :
+                    builder.addExpiringValue(key, iter.value(), iter.expire_time(), sequence);
+            } else {
+                result = addValue(builder, blob_builder, IOPriority::HIGH, key, iter.value(), sequence);
+            }
+        }
+        for (const auto& [begin, fragment]: immutable_mem_table->get_range_tombstones()) {
+            for (uint64_t sequence: fragment.sequences) {
+                builder.addRangeTombstone(begin, fragment.end, sequence);
+            }
+        }
+        result = finishBlobFile(blob_builder, new_blob_files) || result;
+        if (result || builder.finish()) {
+            printf("Error: write sstable %s failed.\n", filename.c_str());
+            removeOutputs({filename}, new_blob_files);
+            return -1;
+        }
+        sstable = std::move(builder.get_sstable());
+        return 0;
+    }
+
+    // flush the immutable memtable, it is kept if that fails
+    int minorCompaction()
+    {
+        vector<BlobFileMeta> new_blob_files;
+        SSTable<KType, VType> sstable;
+        if (writeImmutableToDisk(++curr_timestamp, sstable, new_blob_files)) {
+            return -1;
+        }
        // std::cout<< "minor Compaction, acquire for rw_lock" << std::endl;
         std::unique_lock rw_lock(rw_mutex);
         //std::cout<< "minor Compaction, get rw_lock" << std::endl;
 
-        sstables[0].push_back(std::move(sstable));
+        auto old_sstables = sstables;
+        auto old_blob_files = blob_files;
+        for (const auto& blob_file: new_blob_files) {
+            blob_files[blob_file.file_number] = blob_file;
+        }
+        sstables[0].push_back(make_shared<SSTable<KType, VType>>(std::move(sstable)));
+        if (installChange(std::move(old_sstables), std::move(old_blob_files))) {
+            return -1;
+        }
 
+        if (options.write_buffer_manager) {
+            options.write_buffer_manager -> freeMem(immutable_mem_table -> get_memory_usage());
+        }
         immutable_mem_table.reset();
+        return 0;
     }
 
 
-    void del(const KType key) {
-        put(key, DeleteMarker<VType>::value());
+    // report the growth (or shrink) of the mutable memtable to the write buffer manager
+    void updateWriteBufferUsage(uint64_t old_memory_usage, uint64_t new_memory_usage) {
+        if (new_memory_usage >= old_memory_usage) {
+            options.write_buffer_manager -> reserveMem(write_buffer_owner_id, new_memory_usage - old_memory_usage);
+        } else {
+            options.write_buffer_manager -> scheduleFreeMem(write_buffer_owner_id, old_memory_usage - new_memory_usage);
+            options.write_buffer_manager -> freeMem(old_memory_usage - new_memory_usage);
+        }
     }
 
-    void majorCompaction() {
-        std::map<KType, VType> k2v;
-        std::map<KType, uint64_t> k2timestamp;
-        size_t sstable_num = sstables[0].size();
-        vector<SSTable<KType, VType>> new_sstables;
+    FileWriterOptions getFileWriterOptions(IOPriority priority) const {
+        FileWriterOptions writer_options;
+        writer_options.buffer_size = options.writable_file_buffer_size;
+        writer_options.use_direct_io = options.use_direct_io_for_flush_and_compaction;
+        writer_options.rate_limiter = options.rate_limiter;
+        writer_options.priority = priority;
+        return writer_options;
+    }
 
-        // read all kv-pairs to k2v and k2timestamp
-        for (auto sstable:sstables[0]) {
-            std::ifstream sstable_file(std::format("{}/{}-{}.sst", db_path, sstable.level, sstable.order), std::ios::binary | std::ios::in);
-            auto timestamp = sstable.header.timestamp;
-            for (size_t i = 0; i < sstable.index.size(); i++) {
-                auto key = sstable.index[i].key;
-                auto offset = sstable.index[i].offset;
-                if (!k2timestamp.contains(key) || k2timestamp[key] < timestamp) {
-                    k2timestamp[key] = timestamp;
-                    string value_str = readFromSSTable(sstable, i, sstable_file);
-                    VType value = SerializeWrapper<VType>::deserialize(value_str);
-                    if (DeleteMarker<VType>::isDeleted(value)) {
-                        k2v.erase(key);
-                    } else {
-                        k2v[key] = value;
+    SSTableBuilderOptions getSSTableBuilderOptions(uint32_t level, IOPriority priority) const {
+        SSTableBuilderOptions builder_options;
+        builder_options.file_writer_options = getFileWriterOptions(priority);
+        builder_options.block_size = options.block_size;
+        builder_options.learned_index_error_bound = options.learned_index_error_bound;
+        builder_options.use_eytzinger_index = options.use_eytzinger_index;
+        if (!options.compression_per_level.empty()) {
+            builder_options.compression = options.compression_per_level[std::min<size_t>(level, options.compression_per_level.size() - 1)];
+            builder_options.max_dict_bytes = options.zstd_max_dict_bytes;
+            builder_options.max_train_bytes = options.zstd_max_train_bytes;
+        }
+        return builder_options;
+    }
+
+    string getSSTablePath(uint32_t level, uint32_t order) const {
+        return std::format("{}/{}-{}.sst", db_path, level, order);
+    }
+
+    string getSSTableTempPath(uint32_t level, uint32_t order) const {
+        return std::format("{}/{}-{}.sst.temp", db_path, level, order);
+    }
+
+    string getBlobFilePath(uint64_t file_number) const {
+        return std::format("{}/{}.blob", db_path, file_number);
+    }
+
+    // pick subcompaction_num - 1 keys that split the keys of the input sstables
+    // into ranges of (roughly) equal size. Only a sample of the restart keys of the
+    // indexes is read, each of them stands for the same number of entries
+    vector<KType> getSubcompactionBoundaries(const vector<shared_ptr<SSTable<KType, VType>>>& inputs, size_t subcompaction_num) const {
+        if (subcompaction_num <= 1) {
+            return {};
+        }
+        // enough samples per range for the ranges to come out even
+        constexpr size_t kSamplesPerSubcompaction = 64;
+        size_t restart_num = 0;
+        for (const auto& sstable: inputs) {
+            restart_num += sstable->index.get_restarts().size();
+        }
+        size_t stride = std::max<size_t>(restart_num / (subcompaction_num * kSamplesPerSubcompaction), 1);
+        vector<KType> keys;
+        for (const auto& sstable: inputs) {
+            for (size_t restart = 0; restart < sstable->index.get_restarts().size(); restart += stride) {
+                keys.push_back(sstable->index.getRestartKey(restart));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        vector<KType> boundaries;
+        subcompaction_num = std::min(subcompaction_num, keys.size());
+        for (size_t i = 1; i < subcompaction_num; i++) {
+            boundaries.push_back(keys[i * keys.size() / subcompaction_num]);
+        }
+        return boundaries;
+    }
+
+    int finishCompactionOutput(SSTableBuilder<KType, VType>& builder, vector<SSTable<KType, VType>>& new_sstables) {
+        if (builder.finish()) {
+            printf("Error: write sstable %u failed.\n", builder.get_sstable().order);
+            return -1;
+        }
+        new_sstables.push_back(std::move(builder.get_sstable()));
+        return 0;
+    }
+
+    // a version of a key read by compaction
+    struct Version {
+        uint64_t sequence;
+        EntryType type;
+        string payload;
+    };
+
+    // drop the versions of a key no snapshot reads and fold merge operands into the versions they
+    // apply to, versions are newest first. Level 1 is the bottom level: nothing older is left for
+    // the oldest tombstones to hide, and the oldest operand without a value is the value.
+    // Returns -1 if a blob an operand is folded into can't be read
+    int collapseVersions(vector<Version>& versions, const vector<uint64_t>& snapshot_sequences, uint64_t now) const {
+        vector<Version> kept;
+        size_t last_stripe = 0;
+        for (auto& version: versions) {
+            if (version.type == EntryType::EXPIRING_VALUE && ExpiringValue::getExpireTime(version.payload) <= now) {
+                version.type = EntryType::DELETION;
+                version.payload.clear();
+            }
+            size_t stripe = getSnapshotStripe(snapshot_sequences, version.sequence);
+            if (kept.empty() || stripe != last_stripe) {
+                kept.push_back(std::move(version));
+                last_stripe = stripe;
+                continue;
+            }
+            Version& newer = kept.back();
+            if (newer.type != EntryType::MERGE) {
+                continue;
+            }
+            // fold the newer operand into this version
+            if (version.type == EntryType::DELETION) {
+                newer.type = EntryType::VALUE;
+            } else if (version.type == EntryType::BLOB_INDEX) {
+                string value_str;
+                if (readBlob(version.payload, value_str)) {
+                    return -1;
+                }
+                newer.payload = mergePayloads(value_str, newer.payload);
+                newer.type = EntryType::VALUE;
+            } else if (version.type == EntryType::EXPIRING_VALUE) {
+                newer.payload = ExpiringValue::encode(ExpiringValue::getExpireTime(version.payload),
+                    mergePayloads(ExpiringValue::getValue(version.payload), newer.payload));
+                newer.type = version.type;
+            } else {
+                newer.payload = mergePayloads(version.payload, newer.payload);
+                newer.type = version.type;
+            }
+        }
+        while (!kept.empty() && kept.back().type == EntryType::DELETION) {
+            kept.pop_back();
+        }
+        if (!kept.empty() && kept.back().type == EntryType::MERGE) {
+            kept.back().type = EntryType::VALUE;
+        }
+        versions = std::move(kept);
+        return 0;
+    }
+
+    // merge all versions of keys in [lower, upper) of the input sstables and write the versions
+    // the snapshots read to level 1 sstables of about target_file_size bytes, a null bound means
+    // the range is unbounded on that side. The inputs are merged key by key, so only the versions
+    // of one key are held at a time. The sstables are written to temp files. Blobs still
+    // referenced in gc_blob_files are rewritten to a new blob file, other blob indexes are kept as they are.
+    // If anything fails, the files written are removed
+    int doSubcompaction(const vector<shared_ptr<SSTable<KType, VType>>>& inputs,
+        uint64_t timestamp, const KType* lower, const KType* upper, const vector<uint64_t>& snapshot_sequences,
+        const std::set<uint64_t>& gc_blob_files, vector<SSTable<KType, VType>>& new_sstables, vector<BlobFileMeta>& new_blob_files) {
+        uint64_t now = nowMs();
+        auto in_range = [upper](const typename SSTableIndex<KType>::Iterator& iter) {
+            return iter.valid() && (upper == nullptr || iter.get_entry().key < *upper);
+        };
+
+        // the next entry of every input in the range, the heap yields the input with the smallest one
+        vector<typename SSTableIndex<KType>::Iterator> iters;
+        vector<unique_ptr<SSTableReader<KType, VType>>> readers;
+        auto greater = [&iters](size_t a, size_t b) {
+            return iters[b].get_entry().key < iters[a].get_entry().key;
+        };
+        std::priority_queue<size_t, vector<size_t>, decltype(greater)> heap(greater);
+        vector<shared_ptr<SSTable<KType, VType>>> range_deleting_inputs;
+        for (const auto& sstable: inputs) {
+            auto iter = lower == nullptr ? sstable->index.begin() : sstable->index.lowerBound(*lower);
+            if (in_range(iter)) {
+                iters.push_back(iter);
+                readers.push_back(make_unique<SSTableReader<KType, VType>>(*sstable, getSSTablePath(sstable->level, sstable->order), options.verify_checksums));
+                heap.push(iters.size() - 1);
+            }
+            if (!sstable->range_tombstones.empty()) {
+                range_deleting_inputs.push_back(sstable);
+            }
+        }
+
+        // construct new sstables, cut a new one whenever the current one reaches target_file_size
+        unique_ptr<SSTableBuilder<KType, VType>> builder;
+        unique_ptr<BlobFileBuilder<KType>> blob_builder;
+        vector<string> output_paths;
+        int result = 0;
+        vector<Version> versions;
+        while (!heap.empty() && !result) {
+            // collect the versions of the smallest key left from every input holding it
+            KType key = iters[heap.top()].get_entry().key;
+            versions.clear();
+            while (!heap.empty() && !result && iters[heap.top()].get_entry().key == key) {
+                size_t input = heap.top();
+                heap.pop();
+                auto& iter = iters[input];
+                for (; iter.valid() && iter.get_entry().key == key; iter.next()) {
+                    // the inputs may hold the only good copy of a version, they are kept if it can't be read
+                    Version version;
+                    if (readers[input]->read(iter.get_entry(), version.type, version.sequence, version.payload)) {
+                        result = -1;
+                        break;
+                    }
+                    versions.push_back(std::move(version));
+                }
+                if (!result && in_range(iter)) {
+                    heap.push(input);
+                }
+            }
+            if (result) {
+                break;
+            }
+            // a range tombstone deletes older versions just like a tombstone of key, the range tombstones
+            // themselves are not kept: tombstones of key are kept instead where snapshots need them
+            for (const auto& sstable: range_deleting_inputs) {
+                if (const auto* sequences = sstable->range_tombstones.getSequences(key)) {
+                    for (uint64_t sequence: *sequences) {
+                        versions.push_back(Version{sequence, EntryType::DELETION, ""});
                     }
                 }
             }
+            std::sort(versions.begin(), versions.end(), [](const Version& a, const Version& b) {
+                return a.sequence > b.sequence;
+            });
+            if (collapseVersions(versions, snapshot_sequences, now)) {
+                result = -1;
+                break;
+            }
+            if (versions.empty()) {
+                continue;
+            }
+            if (builder == nullptr) {
+                uint32_t order = next_file_number++;
+                builder = make_unique<SSTableBuilder<KType, VType>>(getSSTableBuilderOptions(1, IOPriority::LOW));
+                output_paths.push_back(getSSTableTempPath(1, order));
+                if (builder->open(output_paths.back(), 1, order, timestamp)) {
+                    printf("Error: create sstable %u failed.\n", order);
+                    result = -1;
+                    break;
+                }
+            }
+            for (auto version = versions.begin(); version != versions.end() && !result; ++version) {
+                const auto& [sequence, type, payload] = *version;
+                BlobIndex blob_index;
+                if (type == EntryType::VALUE) {
+                    result = addValue(*builder, blob_builder, IOPriority::LOW, key, payload, sequence);
+                } else if (type != EntryType::BLOB_INDEX) {
+                    result = builder->addEntry(key, type, payload, sequence);
+                } else if (blob_index.decode(payload)) {
+                    result = -1;
+                } else if (!gc_blob_files.contains(blob_index.file_number)) {
+                    result = builder->addBlobIndex(key, blob_index, sequence);
+                } else {
+                    string value_str;
+                    result = readBlob(payload, value_str) || addValue(*builder, blob_builder, IOPriority::LOW, key, value_str, sequence);
+                }
+                if (result) {
+                    printf("Error: write sstable %u failed.\n", builder->get_sstable().order);
+                }
+            }
+            // the versions of a key are kept in one sstable
+            if (!result && builder->get_file_size() >= options.target_file_size) {
+                result = finishCompactionOutput(*builder, new_sstables);
+                builder.reset();
+            }
+        }
+        if (!result && builder != nullptr) {
+            result = finishCompactionOutput(*builder, new_sstables);
+        }
+        result = finishBlobFile(blob_builder, new_blob_files) || result;
+        if (result) {
+            builder.reset();
+            removeOutputs(output_paths, new_blob_files);
+            new_sstables.clear();
+            new_blob_files.clear();
+            return -1;
+        }
+        return 0;
+    }
+
+    // merge level 0 and level 1 into a new level 1,
+    // level 0 sstables flushed while compacting are kept. If it fails, nothing is changed
+    int majorCompaction() {
+        vector<shared_ptr<SSTable<KType, VType>>> inputs;
+        uint64_t input_size = 0;
+        // the newest input timestamp, sstables flushed later are always newer
+        uint64_t timestamp = 0;
+        // blob files with enough garbage, their live blobs are moved to new blob files
+        std::set<uint64_t> gc_blob_files;
+        // snapshots taken later see all versions of the inputs
+        vector<uint64_t> snapshot_sequences;
+        {
+            std::shared_lock rw_lock(rw_mutex);
+            for (size_t level = 0; level < 2; level++) {
+                for (const auto& sstable: sstables[level]) {
+                    inputs.push_back(sstable);
+                    input_size += sstable->file_size;
+                    timestamp = std::max(timestamp, sstable->header.timestamp);
+                }
+            }
+            for (const auto& [file_number, blob_file]: blob_files) {
+                if (blob_file.getGarbageRatio() >= options.blob_garbage_collection_threshold) {
+                    gc_blob_files.insert(file_number);
+                }
+            }
+            snapshot_sequences = getSnapshotSequences();
         }
 
-        size_t kv_num = k2v.size();
-        size_t new_sstable_num = sstable_num / 2;
-        size_t kv_num_per_sstable = kv_num / new_sstable_num;
-        curr_timestamp++;
-        auto iter = k2v.begin();
-
-        // construct new sstables
-        if (kv_num > 0) {
-            for (size_t i = 0; i < new_sstable_num ; i++) {
-                SSTable<KType, VType> sstable;
-                vector<VType*> value_ptr_vec;
-                sstable.level = 0;
-                sstable.order = i;
-                sstable.header.timestamp = curr_timestamp;
-                sstable.header.kv_count = kv_num_per_sstable + (i == new_sstable_num - 1 ? kv_num % new_sstable_num : 0);
-                sstable.bloom_filter = BloomFilter<KType>();
-                size_t begin = i * kv_num_per_sstable;
-                size_t end = begin + sstable.header.kv_count;
-                sstable.header.min_key = iter->first;
-                size_t offset = sstable.header.getHeaderSpace() +
-                    sstable.header.kv_count * (sizeof(SSTableIndex::key) + sizeof(SSTableIndex::offset)) +
-                    sstable.bloom_filter.bit_array.size() / 8 * sizeof(bool);
-                for (int j = begin; j < end; j++) {
-                    const KType &key = iter->first;
-                    const VType &value = iter->second;
-                    value_ptr_vec.push_back(&(iter->second));
-                    sstable.bloom_filter.put(key);
-                    sstable.index.emplace_back(key, offset);
-                    offset += SerializeWrapper<VType>::serialize_size(value);
-                    ++iter;
+        // split the compaction into disjoint key ranges, each merged by its own thread
+        size_t max_subcompactions = std::min<uint64_t>(options.max_subcompactions, std::max<uint64_t>(input_size / options.target_file_size, 1));
+        vector<KType> boundaries = getSubcompactionBoundaries(inputs, max_subcompactions);
+        size_t subcompaction_num = boundaries.size() + 1;
+        vector<vector<SSTable<KType, VType>>> sub_sstables(subcompaction_num);
+        vector<vector<BlobFileMeta>> sub_blob_files(subcompaction_num);
+        vector<int> sub_results(subcompaction_num);
+
+        vector<std::thread> workers;
+        for (size_t i = 0; i < subcompaction_num; i++) {
+            const KType* lower = i == 0 ? nullptr : &boundaries[i - 1];
+            const KType* upper = i == subcompaction_num - 1 ? nullptr : &boundaries[i];
+            if (subcompaction_num == 1) {
+                sub_results[i] = doSubcompaction(inputs, timestamp, lower, upper, snapshot_sequences, gc_blob_files, sub_sstables[i], sub_blob_files[i]);
+            } else {
+                workers.emplace_back([this, &inputs, &sub_sstables, &snapshot_sequences, &gc_blob_files, &sub_blob_files, &sub_results, i, timestamp, lower, upper]() {
+                    sub_results[i] = doSubcompaction(inputs, timestamp, lower, upper, snapshot_sequences, gc_blob_files, sub_sstables[i], sub_blob_files[i]);
+                });
+            }
+        }
+        for (auto& worker: workers) {
+            worker.join();
+        }
+
+        // the outputs are renamed before they are installed, they are all removed if any subcompaction failed
+        bool failed = std::find(sub_results.begin(), sub_results.end(), -1) != sub_results.end();
+        vector<string> output_paths;
+        vector<BlobFileMeta> output_blob_files;
+        for (size_t i = 0; i < subcompaction_num; i++) {
+            for (const auto& sstable: sub_sstables[i]) {
+                std::error_code ec;
+                output_paths.push_back(getSSTableTempPath(sstable.level, sstable.order));
+                if (!failed) {
+                    std::filesystem::rename(output_paths.back(), getSSTablePath(sstable.level, sstable.order), ec);
+                    output_paths.push_back(getSSTablePath(sstable.level, sstable.order));
                 }
-                --iter;
-                sstable.header.max_key = iter -> first;
-                ++iter;
-
-                string filename = std::format("{}/{}-{}.sst.temp", db_path, sstable.level, sstable.order);
-                std::ofstream sstable_file(filename, std::ios::binary | std::ios::out);
-                // write metadata to file
-                sstable.writeToFile(sstable_file);
-
-                for (int j = begin; j < end; j++) {
-                    sstable_file.write(SerializeWrapper<VType>::serialize(*(value_ptr_vec[j- begin])).c_str(),
-                    SerializeWrapper<VType>::serialize_size(*(value_ptr_vec[j- begin])));
+                if (ec) {
+                    printf("Error: rename sstable %u failed.\n", sstable.order);
+                    failed = true;
                 }
-                sstable_file.close();
-                new_sstables.push_back(sstable);
             }
+            output_blob_files.insert(output_blob_files.end(), sub_blob_files[i].begin(), sub_blob_files[i].end());
+        }
+        if (failed) {
+            printf("Error: major compaction failed, its inputs are kept.\n");
+            removeOutputs(output_paths, output_blob_files);
+            return -1;
         }
 
+        // install the outputs of all subcompactions together
         std::unique_lock rw_lock(rw_mutex);
+        auto old_sstables = sstables;
+        auto old_blob_files = blob_files;
 
-        for (const auto& entry : std::filesystem::directory_iterator(db_path)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".sst") {
-                std::filesystem::remove(entry.path());
-                //std::cout << "已删除文件: " << entry.path() << std::endl;
+        // sstables ingested while compacting are kept, they don't overlap the inputs
+        for (auto& sstable_level: sstables) {
+            std::erase_if(sstable_level, [&inputs](const auto& sstable) {
+                return std::find(inputs.begin(), inputs.end(), sstable) != inputs.end();
+            });
+        }
+
+        for (auto& sstable_vec: sub_sstables) {
+            for (auto& sstable: sstable_vec) {
+                sstables[1].push_back(make_shared<SSTable<KType, VType>>(std::move(sstable)));
             }
         }
+        for (auto& blob_file_vec: sub_blob_files) {
+            for (auto& blob_file: blob_file_vec) {
+                blob_files[blob_file.file_number] = blob_file;
+            }
+        }
+        vector<uint64_t> obsolete_blob_files = updateBlobFiles();
+        // the old files are deleted once the manifest doesn't list them anymore
+        if (installChange(std::move(old_sstables), std::move(old_blob_files))) {
+            printf("Error: major compaction failed, its inputs are kept.\n");
+            return -1;
+        }
+        // the compaction is committed, a file that can't be removed is only left behind
+        std::error_code ec;
+        for (const auto& sstable: inputs) {
+            if (!std::filesystem::remove(getSSTablePath(sstable->level, sstable->order), ec) && ec) {
+                printf("Error: remove sstable %s failed.\n", getSSTablePath(sstable->level, sstable->order).c_str());
+            }
+        }
+        for (uint64_t file_number: obsolete_blob_files) {
+            if (!std::filesystem::remove(getBlobFilePath(file_number), ec) && ec) {
+                printf("Error: remove blob file %s failed.\n", getBlobFilePath(file_number).c_str());
+            }
+        }
+        return 0;
+    }
 
-        for (const auto& entry : std::filesystem::directory_iterator(db_path)) {
-            if (entry.is_regular_file()) {
-                const auto& path = entry.path();
-                std::string filename = path.filename().string();
-                size_t pos = filename.rfind(".sst.temp");
-                if (pos != std::string::npos) {
-                    std::string new_name = filename.substr(0, pos) + ".sst";
-                    std::filesystem::path new_path = path.parent_path() / new_name;
-                    std::filesystem::rename(path, new_path);
-                    //std::cout << "已重命名: " << path << " -> " << new_path << std::endl;
+    // recount the live bytes of every blob file from the sstables referencing it, and drop the
+    // blob files no sstable references anymore, returns their file numbers. rw_mutex must be held
+    vector<uint64_t> updateBlobFiles() {
+        for (auto& [file_number, blob_file]: blob_files) {
+            blob_file.live_bytes = 0;
+        }
+        for (const auto& sstable_level: sstables) {
+            for (const auto& sstable: sstable_level) {
+                for (const auto& [file_number, bytes]: sstable->blob_bytes) {
+                    auto iter = blob_files.find(file_number);
+                    if (iter != blob_files.end()) {
+                        iter->second.live_bytes += bytes;
+                    }
+                }
+            }
+        }
+        vector<uint64_t> obsolete_blob_files;
+        std::erase_if(blob_files, [&obsolete_blob_files](const auto& item) {
+            if (item.second.live_bytes > 0) {
+                return false;
+            }
+            obsolete_blob_files.push_back(item.first);
+            return true;
+        });
+        return obsolete_blob_files;
+    }
+
+    static string getManifestPath(const string& dir) {
+        return std::format("{}/MANIFEST", dir);
+    }
+
+    // whether the sstable in file path holds a single VALUE or DELETION of each of its keys and
+    // no range tombstones, as SstFileWriter writes them. Every entry is read, so the data blocks
+    // and the offsets of the index into them are verified too. The header must bound the keys
+    // exactly, the sstable is placed by it. Other types are rejected: blob indexes point into the
+    // blob files of another store, merge operands and expiring values are never written by SstFileWriter
+    static bool isIngestible(const SSTable<KType, VType>& sstable, const string& path) {
+        if (sstable.header.kv_count == 0 || !sstable.range_tombstones.empty()) {
+            printf("Error: an ingested sstable must have keys and no range tombstones.\n");
+            return false;
+        }
+        SSTableReader<KType, VType> reader(sstable, path);
+        EntryType type;
+        uint64_t sequence;
+        string payload;
+        uint64_t count = 0;
+        KType last_key{};
+        for (auto iter = sstable.index.begin(); iter.valid(); iter.next(), count++) {
+            if (count > 0 && !(last_key < iter.get_entry().key)) {
+                printf("Error: keys of an ingested sstable are not in strictly increasing order.\n");
+                return false;
+            }
+            if (count == 0 && !(iter.get_entry().key == sstable.header.min_key)) {
+                printf("Error: the min key of an ingested sstable is not its first key.\n");
+                return false;
+            }
+            last_key = iter.get_entry().key;
+            if (reader.read(iter.get_entry(), type, sequence, payload)) {
+                return false;
+            }
+            if (type != EntryType::VALUE && type != EntryType::DELETION) {
+                printf("Error: an ingested sstable holds an entry of type %d, only values and deletions can be ingested.\n",
+                    static_cast<int>(type));
+                return false;
+            }
+        }
+        if (!(last_key == sstable.header.max_key)) {
+            printf("Error: the max key of an ingested sstable is not its last key.\n");
+            return false;
+        }
+        return count == sstable.header.kv_count;
+    }
+
+    // hard link (or copy) a file into dir under the same name
+    static int linkFile(const string& path, const string& dir) {
+        std::filesystem::path target = std::filesystem::path(dir) / std::filesystem::path(path).filename();
+        std::error_code ec;
+        std::filesystem::create_hard_link(path, target, ec);
+        if (ec) {
+            ec.clear();
+            std::filesystem::copy_file(path, target, ec);
+        }
+        if (ec) {
+            printf("Error: link %s to %s failed.\n", path.c_str(), target.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+    // write the manifest of db_path after sstables and blob_files changed from old_sstables and
+    // old_blob_files, the old ones are restored if that fails. The new files are left on disk
+    // then, as a manifest that failed to sync may still list them. rw_mutex must be held
+    int installChange(vector<vector<shared_ptr<SSTable<KType, VType>>>> old_sstables, std::map<uint64_t, BlobFileMeta> old_blob_files) {
+        int result = writeManifest(db_path);
+        if (result) {
+            sstables = std::move(old_sstables);
+            blob_files = std::move(old_blob_files);
+        }
+        updateWriteStallCondition();
+        return result;
+    }
+
+    // The manifest lists the live files, so the store can be reopened from them. A line per sstable,
+    // oldest first in level 0, "sstable {level} {file number} {global sequence}" and the bytes it
+    // references in each blob file as " {blob file number}:{bytes}", then a line per blob file,
+    // "blob {file number} {total bytes}". Everything else is read from the files.
+    // It is replaced atomically and synced with dir, so the files it lists are on disk
+    // once it returns. rw_mutex must be held
+    int writeManifest(const string& dir) const {
+        if (status) {
+            printf("Error: the store failed to open, its manifest is kept as it is.\n");
+            return -1;
+        }
+        std::ostringstream manifest;
+        for (const auto& sstable_level: sstables) {
+            for (const auto& sstable: sstable_level) {
+                manifest << "sstable " << sstable->level << " " << sstable->order << " " << sstable->global_sequence;
+                for (const auto& [file_number, bytes]: sstable->blob_bytes) {
+                    manifest << " " << file_number << ":" << bytes;
                 }
+                manifest << "\n";
+            }
+        }
+        for (const auto& [file_number, blob_file]: blob_files) {
+            manifest << "blob " << file_number << " " << blob_file.total_bytes << "\n";
+        }
+        string temp_path = getManifestPath(dir) + ".temp";
+        string content = manifest.str();
+        FileWriterOptions writer_options;
+        writer_options.buffer_size = content.size();
+        FileWriter writer(writer_options);
+        if (writer.open(temp_path) || writer.append(content.data(), content.size()) || writer.close()) {
+            printf("Error: write manifest %s failed.\n", temp_path.c_str());
+            return -1;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, getManifestPath(dir), ec);
+        if (ec) {
+            printf("Error: write manifest %s failed.\n", temp_path.c_str());
+            return -1;
+        }
+        return FileWriter::syncDirectory(dir);
+    }
+
+    // open the files the manifest of db_path lists. Files are numbered, written and timestamped
+    // after the newest of them, writes are numbered after the newest write in them. Files the
+    // manifest doesn't list are left from a flush or compaction that failed and are removed.
+    // Returns -1 with no file opened if a listed file is missing or can't be read
+    int recover() {
+        std::ifstream manifest(getManifestPath(db_path));
+        if (!manifest) {
+            printf("Error: open manifest of %s failed.\n", db_path.c_str());
+            return -1;
+        }
+        string line;
+        int result = 0;
+        while (!result && std::getline(manifest, line)) {
+            std::istringstream fields(line);
+            string kind;
+            uint64_t level = 0, file_number = 0, global_sequence = 0, bytes = 0;
+            char separator;
+            fields >> kind;
+            if (kind == "blob" && fields >> file_number >> bytes) {
+                std::error_code ec;
+                if (std::filesystem::file_size(getBlobFilePath(file_number), ec) != bytes || ec) {
+                    printf("Error: blob file %s is missing or truncated.\n", getBlobFilePath(file_number).c_str());
+                    result = -1;
+                }
+                blob_files[file_number] = BlobFileMeta{file_number, bytes, 0};
+                next_file_number = std::max<uint64_t>(next_file_number, file_number + 1);
+                continue;
+            }
+            if (kind != "sstable" || !(fields >> level >> file_number >> global_sequence) || level >= sstables.size()) {
+                printf("Error: malformed manifest line \"%s\".\n", line.c_str());
+                result = -1;
+                continue;
+            }
+            auto sstable = make_shared<SSTable<KType, VType>>();
+            sstable->level = level;
+            sstable->order = file_number;
+            sstable->global_sequence = global_sequence;
+            if (sstable->readFromFile(getSSTablePath(sstable->level, sstable->order))) {
+                result = -1;
+                continue;
+            }
+            while (fields >> file_number >> separator >> bytes) {
+                sstable->blob_bytes[file_number] += bytes;
+            }
+            if (options.learned_index_error_bound > 0) {
+                sstable->index.buildLearnedIndex(options.learned_index_error_bound);
+            }
+            if (options.use_eytzinger_index) {
+                sstable->index.buildEytzingerLayout();
+            }
+            next_file_number = std::max<uint64_t>(next_file_number, sstable->order + 1);
+            curr_timestamp = std::max<uint64_t>(curr_timestamp, sstable->header.timestamp);
+            last_sequence = std::max<uint64_t>(last_sequence, std::max(sstable->header.max_sequence, global_sequence));
+            sstables[level].push_back(std::move(sstable));
+        }
+        if (result) {
+            printf("Error: recover %s failed.\n", db_path.c_str());
+            sstables.assign(sstables.size(), {});
+            blob_files.clear();
+            return -1;
+        }
+        updateBlobFiles();
+        updateWriteStallCondition();
+        removeUnlistedFiles();
+        return 0;
+    }
+
+    // remove the sstables, blob files and temp files in db_path the store doesn't use, rw_mutex must be held
+    void removeUnlistedFiles() {
+        std::set<string> live_files{"MANIFEST"};
+        for (const auto& sstable_level: sstables) {
+            for (const auto& sstable: sstable_level) {
+                live_files.insert(std::format("{}-{}.sst", sstable->level, sstable->order));
+            }
+        }
+        for (const auto& [file_number, blob_file]: blob_files) {
+            live_files.insert(std::format("{}.blob", file_number));
+        }
+        std::regex pattern(R"(^\d+-\d+\.sst$|^\d+\.blob$|\.temp$)");
+        std::error_code ec;
+        for (const auto& entry: std::filesystem::directory_iterator(db_path, ec)) {
+            string filename = entry.path().filename().string();
+            if (!live_files.contains(filename) && std::regex_search(filename, pattern)) {
+                std::filesystem::remove(entry.path(), ec);
             }
         }
-        sstables[0] = std::move(new_sstables);
     }
 
     vector<string> getAllSSTables() {
@@ -321,21 +1400,4 @@ public:
         }
         return all_sstables;
     }
-
-    string readFromSSTable(SSTable<KType, VType> &sstable,size_t index, std::ifstream &sstable_file) {
-        sstable_file.seekg(sstable.index[index].offset);
-        string value_str;
-        if (index == sstable.index.size() - 1) {
-            char c;
-            while (sstable_file.get(c)) {
-                value_str += c;
-            }
-        } else {
-            uint64_t read_size = sstable.index[index + 1].offset - sstable.index[index].offset;
-            unique_ptr<char[]> value_buffer(new char[read_size]);
-            sstable_file.read(value_buffer.get(), read_size);
-            value_str = string(value_buffer.get(), read_size);
-        }
-        return value_str;
-    }
-};
+};
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "WriteBufferManager.h"
+#include "RateLimiter.h"
+#include "Compression.h"
+
+struct KVStoreOptions {
+    // bytes of keys, values and nodes the memtable holds before it is flushed to level 0
+    uint64_t write_buffer_size{4 * 1024 * 1024};
+
+    // shared by stores that should stay under one memtable budget together,
+    // the store with the largest memtable is flushed when the budget is exceeded
+    std::shared_ptr<WriteBufferManager> write_buffer_manager;
+
+    // compaction output is cut into sstables of about this many bytes
+    uint64_t target_file_size{2 * 1024 * 1024};
+
+    // number of level 0 sstables that triggers a major compaction
+    uint32_t level0_file_num_compaction_trigger{8};
+
+    // writes are delayed to delayed_write_rate once level 0 has this many sstables
+    uint32_t level0_slowdown_writes_trigger{20};
+
+    // writes stop until compaction catches up once level 0 has this many sstables
+    uint32_t level0_stop_writes_trigger{36};
+
+    // writes are delayed once major compaction has this many bytes to rewrite
+    uint64_t soft_pending_compaction_bytes_limit{64ull * 1024 * 1024 * 1024};
+
+    // writes stop once major compaction has this many bytes to rewrite
+    uint64_t hard_pending_compaction_bytes_limit{256ull * 1024 * 1024 * 1024};
+
+    // bytes per second writes are paced to while delayed
+    uint64_t delayed_write_rate{16 * 1024 * 1024};
+
+    // limits the bytes per second of sstable files written by flushes and compactions,
+    // may be shared by several stores
+    std::shared_ptr<RateLimiter> rate_limiter;
+
+    // sstable files are written in chunks of this many bytes
+    size_t writable_file_buffer_size{4 * 1024 * 1024};
+
+    // write sstable files with O_DIRECT, bypassing the page cache
+    bool use_direct_io_for_flush_and_compaction{false};
+
+    // uncompressed bytes of values per sstable data block
+    uint64_t block_size{4096};
+
+    // codec of the blocks of each level, the last one is used for deeper levels,
+    // empty means no compression. Blocks are stored uncompressed if the codec
+    // is not compiled in or doesn't save at least 1/8 of the block
+    std::vector<CompressionType> compression_per_level;
+
+    // max bytes of the zstd dictionary trained for each sstable of a zstd level, 0 disables it.
+    // Small values compress much better with a dictionary trained from their neighbours
+    uint64_t zstd_max_dict_bytes{16 * 1024};
+
+    // uncompressed bytes of values, from the beginning of the sstable, sampled to train its dictionary
+    uint64_t zstd_max_train_bytes{1024 * 1024};
+
+    // store values of at least min_blob_size bytes in blob files, sstables only keep
+    // their location, so compaction doesn't rewrite them
+    bool enable_blob_files{false};
+
+    // serialized bytes of the smallest value stored in a blob file
+    uint64_t min_blob_size{4096};
+
+    // major compaction moves the live values out of blob files with at least this fraction
+    // of garbage, blob files without live values are deleted after every major compaction
+    double blob_garbage_collection_threshold{0.5};
+
+    // fit a piecewise linear model of the keys of every sstable when it is built, lookups search
+    // only the restart points it predicts within this error, 0 uses plain binary search.
+    // Pays off when keys are close to linear, like timestamps or sequential ids
+    size_t learned_index_error_bound{0};
+
+    // search the restart keys of every sstable index in a copy of them in Eytzinger layout,
+    // a cache friendly branchless search costing 12 bytes per restart point. Takes precedence
+    // over learned_index_error_bound
+    bool use_eytzinger_index{false};
+
+    // verify the crc32c of sstable blocks and blob records when they are read from disk,
+    // a block kept by a reader is not verified again
+    bool verify_checksums{true};
+
+    // values written by put without a ttl expire this many ms after the write, 0 keeps them forever.
+    // Expired values read as deleted and are dropped by major compaction
+    uint64_t default_ttl_ms{0};
+
+    // max number of threads a major compaction is split into,
+    // each one merges a disjoint key range and writes its own sstables
+    uint32_t max_subcompactions{std::max(1u, std::thread::hardware_concurrency())};
+
+    // 0 if the options can be used, writes could stall forever if level 0 stopped them
+    // before it had enough sstables to be compacted
+    int validate() const {
+        if (level0_file_num_compaction_trigger == 0 ||
+            level0_file_num_compaction_trigger >= level0_slowdown_writes_trigger ||
+            level0_slowdown_writes_trigger >= level0_stop_writes_trigger) {
+            printf("Error: level0_file_num_compaction_trigger < level0_slowdown_writes_trigger < level0_stop_writes_trigger doesn't hold.\n");
+            return -1;
+        }
+        if (soft_pending_compaction_bytes_limit > hard_pending_compaction_bytes_limit) {
+            printf("Error: soft_pending_compaction_bytes_limit is above hard_pending_compaction_bytes_limit.\n");
+            return -1;
+        }
+        return 0;
+    }
+};
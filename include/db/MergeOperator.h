@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// Combines the operands of KVStore::merge with the value of their key. merge must be associative,
+// merge(merge(a, b), c) == merge(a, merge(b, c)), so operands are folded together before the value
+// they apply to is found, in the memtable and in compaction. A key without a value takes the
+// value of its oldest operand.
+template<typename VType>
+class MergeOperator {
+    public:
+        virtual ~MergeOperator() = default;
+
+        // existing is the older value or operand of the key, operand the newer one
+        virtual VType merge(const VType& existing, const VType& operand) const = 0;
+};
+
+// counters: the value is the sum of the operands
+template<typename VType>
+class AddOperator: public MergeOperator<VType> {
+    public:
+        VType merge(const VType& existing, const VType& operand) const override {
+            return existing + operand;
+        }
+};
+
+// lists: operands are appended to the value, separated by delimiter
+class AppendOperator: public MergeOperator<std::string> {
+    private:
+        std::string delimiter;
+    public:
+        explicit AppendOperator(std::string delimiter_ = ","): delimiter(std::move(delimiter_)) {}
+
+        std::string merge(const std::string& existing, const std::string& operand) const override {
+            return existing + delimiter + operand;
+        }
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// A point in time of a KVStore: reads at a snapshot see the writes made before it was taken
+// and none of those made after. Compaction keeps the versions of keys a snapshot sees until it
+// is released, when the last shared_ptr to it is destroyed, which must be before the KVStore is
+class Snapshot {
+public:
+    explicit Snapshot(uint64_t sequence_): sequence(sequence_) {}
+
+    // sequence number of the last write visible at the snapshot
+    const uint64_t sequence;
+};
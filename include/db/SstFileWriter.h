@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "SSTableBuilder.h"
+
+// Builds an sstable file outside of a KVStore, e.g. from sorted input of a bulk load, to be added
+// to a store by KVStore::ingestExternalFile. Keys must be added in strictly increasing order,
+// values are stored inline in the file
+template<typename KType, typename VType>
+class SstFileWriter {
+    private:
+        SSTableBuilderOptions options;
+        // a new builder for each file
+        std::unique_ptr<SSTableBuilder<KType, VType>> builder;
+        bool has_last_key{false};
+        KType last_key{};
+
+        // the writer must be open and key greater than the keys added before
+        int checkKey(const KType& key) {
+            if (builder == nullptr) {
+                printf("Error: the sst file is not open.\n");
+                return -1;
+            }
+            if (has_last_key && !(last_key < key)) {
+                printf("Error: keys of an sst file must be added in strictly increasing order.\n");
+                return -1;
+            }
+            has_last_key = true;
+            last_key = key;
+            return 0;
+        }
+    public:
+        explicit SstFileWriter(const SSTableBuilderOptions& options_ = SSTableBuilderOptions()): options(options_) {}
+
+        int open(const std::string& filename) {
+            has_last_key = false;
+            builder = std::make_unique<SSTableBuilder<KType, VType>>(options);
+            if (builder->open(filename, 0, 0, 0)) {
+                builder.reset();
+                return -1;
+            }
+            return 0;
+        }
+
+        int put(const KType& key, const VType& value) {
+            if (checkKey(key)) {
+                return -1;
+            }
+            return builder->add(key, value);
+        }
+
+        // a tombstone of key, it deletes the key in the store the file is ingested into
+        int del(const KType& key) {
+            if (checkKey(key)) {
+                return -1;
+            }
+            return builder->addEntry(key, EntryType::DELETION, "");
+        }
+
+        // write the rest of the file, at least one key must have been added.
+        // The writer takes no more keys until it is opened again
+        int finish() {
+            if (builder == nullptr) {
+                printf("Error: the sst file is not open.\n");
+                return -1;
+            }
+            if (builder->get_kv_count() == 0) {
+                printf("Error: an sst file needs at least one key.\n");
+                return -1;
+            }
+            int result = builder->finish();
+            builder.reset();
+            return result;
+        }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+enum class WriteStallCondition {
+    NORMAL,
+    // writes are delayed to delayed_write_rate
+    DELAYED,
+    // writes wait until compaction catches up
+    STOPPED,
+};
+
+// Token bucket that paces delayed writes to delayed_write_rate bytes per second.
+class WriteController {
+    private:
+        // idle time is credited for at most this long, so a writer back from idle gets a
+        // short burst without delay but no more than that
+        static constexpr uint64_t kMaxCreditMicros = 1000;
+
+        uint64_t delayed_write_rate;
+        std::mutex mutex;
+        // bytes that may be written without delay
+        uint64_t credit{0};
+        // time up to which credit has been refilled, may be in the future
+        // when writers have been told to wait
+        uint64_t last_refill_micros;
+
+        static uint64_t nowMicros() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    public:
+        explicit WriteController(uint64_t delayed_write_rate_):
+            delayed_write_rate(std::max<uint64_t>(delayed_write_rate_, 1)), last_refill_micros(nowMicros()) {}
+
+        // microseconds the writer of bytes should sleep before writing
+        uint64_t getDelay(uint64_t bytes) {
+            std::lock_guard guard(mutex);
+            uint64_t now = nowMicros();
+            if (now > last_refill_micros) {
+                uint64_t max_credit = delayed_write_rate * kMaxCreditMicros / 1000000;
+                uint64_t elapsed_micros = std::min(now - last_refill_micros, kMaxCreditMicros);
+                credit = std::min(credit + elapsed_micros * delayed_write_rate / 1000000, max_credit);
+                last_refill_micros = now;
+            }
+            if (credit >= bytes) {
+                credit -= bytes;
+                return 0;
+            }
+            // wait for the missing bytes after everyone already waiting
+            last_refill_micros += (bytes - credit) * 1000000 / delayed_write_rate;
+            credit = 0;
+            return last_refill_micros - now;
+        }
+};
@@ -21,7 +21,9 @@
 #include <braft/protobuf_file.h>         // braft::ProtoBufFile
 #include "kvstore.pb.h"                 // CounterService
 #include "KVStore.h"
+#include <filesystem>
 #include <string>
+#include <vector>
 
 DEFINE_bool(check_term, true, "Check if the leader changed to another term");
 DEFINE_bool(disable_cli, false, "Don't allow raft_cli access this node");
@@ -267,6 +269,91 @@ friend class KVStoreClosure;
         }
     }
 
+    // A snapshot is a checkpoint of the store in the kvstore directory of the snapshot,
+    // its sstable and blob files are hard links, so saving it doesn't copy any data
+    void on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        // the checkpoint flushes the memtable, so it holds every task applied so far
+        const std::string checkpoint_path = writer->get_path() + "/kvstore";
+        if (kvstore_ptr->createCheckpoint(checkpoint_path) != 0) {
+            done->status().set_error(EIO, "Fail to create checkpoint in %s", checkpoint_path.c_str());
+            return;
+        }
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(checkpoint_path, ec)) {
+            if (writer->add_file("kvstore/" + entry.path().filename().string()) != 0) {
+                done->status().set_error(EIO, "Fail to add file to writer");
+                return;
+            }
+        }
+        if (ec) {
+            done->status().set_error(EIO, "Fail to list %s", checkpoint_path.c_str());
+        }
+    }
+
+    // replace the store with the checkpoint of the snapshot. The checkpoint is staged in a
+    // directory next to the store first, the store directory is only swapped for it once
+    // every file is in place, and the store is reopened whether that succeeds or not
+    int on_snapshot_load(braft::SnapshotReader* reader) {
+        CHECK(!is_leader()) << "Leader is not supposed to load snapshot";
+        std::vector<std::string> files;
+        reader->list_files(&files);
+        const std::string staging_path = FLAGS_db_path + ".loading";
+        const std::string old_path = FLAGS_db_path + ".old";
+        std::error_code ec;
+        std::filesystem::remove_all(staging_path, ec);
+        if (ec || !std::filesystem::create_directories(staging_path, ec)) {
+            LOG(ERROR) << "Fail to create " << staging_path << ": " << ec.message();
+            return -1;
+        }
+        // the files are linked, not copied, they are never modified in place
+        for (const std::string& file : files) {
+            if (file.rfind("kvstore/", 0) != 0) {
+                continue;
+            }
+            const std::filesystem::path source = std::filesystem::path(reader->get_path()) / file;
+            const std::filesystem::path target = std::filesystem::path(staging_path) / source.filename();
+            ec.clear();
+            std::filesystem::create_hard_link(source, target, ec);
+            if (ec) {
+                ec.clear();
+                std::filesystem::copy_file(source, target, ec);
+            }
+            if (ec) {
+                LOG(ERROR) << "Fail to load " << source << " into " << staging_path << ": " << ec.message();
+                std::filesystem::remove_all(staging_path, ec);
+                return -1;
+            }
+        }
+
+        // the store is closed while its directory is swapped
+        kvstore_ptr.reset();
+        int result = 0;
+        std::filesystem::remove_all(old_path, ec);
+        if (!ec && std::filesystem::exists(FLAGS_db_path, ec)) {
+            std::filesystem::rename(FLAGS_db_path, old_path, ec);
+        }
+        if (!ec) {
+            std::filesystem::rename(staging_path, FLAGS_db_path, ec);
+            if (ec) {
+                std::error_code restore_ec;
+                std::filesystem::rename(old_path, FLAGS_db_path, restore_ec);
+            }
+        }
+        if (ec) {
+            LOG(ERROR) << "Fail to replace " << FLAGS_db_path << " with the snapshot: " << ec.message();
+            result = -1;
+        }
+        std::filesystem::remove_all(old_path, ec);
+        std::filesystem::remove_all(staging_path, ec);
+        kvstore_ptr = make_unique<KVStore<int64_t, string>>(FLAGS_db_path);
+        if (kvstore_ptr->get_status() != 0) {
+            LOG(ERROR) << "Fail to open " << FLAGS_db_path;
+            result = -1;
+        }
+        return result;
+    }
+
     void on_leader_start(int64_t term) {
         _leader_term.store(term, butil::memory_order_release);
         LOG(INFO) << "Node becomes leader";
@@ -331,8 +418,7 @@ friend class KVStoreClosure;
             key = req.key();
             value = req.value();
         }
-        kvstore_ptr -> put(key, value);
-        response->set_success(true);
+        response->set_success(kvstore_ptr -> put(key, value) == 0);
         response->set_key(key);
     }
 
@@ -350,8 +436,7 @@ friend class KVStoreClosure;
             CHECK(req.ParseFromZeroCopyStream(&wrapper));
             key = req.key();
         }
-        kvstore_ptr -> del(key);
-        response->set_success(true);
+        response->set_success(kvstore_ptr -> del(key) == 0);
         response->set_key(key);
     }
 
@@ -0,0 +1,79 @@
+#include "TestUtil.h"
+
+int main()
+{
+    // 8KB values go to blob files, small ones stay in the sstables
+    KVStoreOptions options = getTestOptions();
+    options.write_buffer_size = 1024 * 1024;
+    options.target_file_size = 256 * 1024;
+    options.enable_blob_files = true;
+    options.min_blob_size = 4096;
+
+    std::filesystem::remove_all("./blobdb");
+    {
+        KVStore<uint64_t, std::string> kv_store("./blobdb", options);
+        // every round overwrites all keys, the blobs of the previous rounds become garbage
+        for(int round = 0; round < 5; round++)
+        {
+            for(uint64_t i = 0; i < 1000; i++)
+            {
+                size_t size = i % 2 ? 8192 : 100;
+                kv_store.put(i, std::string(size, 'a' + (i + round) % 26));
+            }
+        }
+        for(uint64_t i = 0; i < 1000; i += 3)
+            kv_store.del(i);
+
+        int wrong = 0;
+        for(uint64_t i = 0; i < 1000; i++)
+        {
+            auto val_ptr = kv_store.get(i);
+            size_t size = i % 2 ? 8192 : 100;
+            wrong += i % 3 == 0 ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != std::string(size, 'a' + (i + 4) % 26);
+        }
+        check(wrong == 0, std::format("blob values: {} wrong", wrong));
+    }
+
+    // live blobs are 333 values of 8KB, garbage collection keeps the rest of the blob bytes bounded
+    uint64_t blob_file_num = 0, blob_bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator("./blobdb")) {
+        if (entry.path().extension() == ".blob") {
+            blob_file_num++;
+            blob_bytes += entry.file_size();
+        }
+    }
+    check(blob_bytes <= 3 * 333 * 8192, std::format("blob files: {}, blob bytes: {}, live bytes: {}", blob_file_num, blob_bytes, 333 * 8192));
+
+    // an entry that can't be read is an error rather than a missing or older value, and compaction
+    // keeps the sstable holding it instead of dropping the entry
+    options = getTestOptions();
+    options.enable_blob_files = true;
+    std::filesystem::remove_all("./blobdb");
+    std::string corrupted_path;
+    {
+        KVStore<uint64_t, std::string> kv_store("./blobdb", options);
+        // a single sstable
+        for(uint64_t i = 0; i < 200; i++)
+            kv_store.put(i, std::string(100, 'a'));
+        check(kv_store.flush() == 0, "flush the small values");
+        for (const auto& entry : std::filesystem::directory_iterator("./blobdb")) {
+            if (entry.path().extension() == ".sst")
+                corrupted_path = entry.path().string();
+        }
+        // a byte of the first data block
+        std::fstream file(corrupted_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(10);
+        file.put('x');
+        file.close();
+
+        std::unique_ptr<std::string> value;
+        int result = kv_store.get(0, value);
+        check(result == -1 && value == nullptr, std::format("corrupted entry: {}, {}", result, value == nullptr ? "null" : *value));
+        // enough flushes to trigger a major compaction
+        for(uint64_t i = 1000; i < 5000; i++)
+            kv_store.put(i, std::string(100, 'b'));
+    }
+    check(std::filesystem::exists(corrupted_path), "corrupted sstable kept");
+    std::filesystem::remove_all("./blobdb");
+    return failed_checks != 0;
+}
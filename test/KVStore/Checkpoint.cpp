@@ -0,0 +1,118 @@
+#include "TestUtil.h"
+#include <random>
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+    options.enable_blob_files = true;
+    options.min_blob_size = 100;
+
+    std::filesystem::remove_all("./checkpointdb");
+    std::filesystem::remove_all("./checkpoint");
+    std::map<uint64_t, std::string> expected;
+    std::mt19937_64 rng(0);
+    {
+        KVStore<uint64_t, std::string> kv_store("./checkpointdb", options);
+        // small values stay in the sstables, large ones go to blob files
+        for(int i = 0; i < 100000; i++) {
+            uint64_t key = rng() % 20000;
+            std::string value = std::format("{}-{}", key, i) + std::string(rng() % 2 ? 0 : 150, 'v');
+            kv_store.put(key, value);
+            expected[key] = value;
+            if(i % 10000 == 0) {
+                kv_store.deleteRange(key, key + 500);
+                expected.erase(expected.lower_bound(key), expected.lower_bound(key + 500));
+            }
+        }
+        int result = kv_store.createCheckpoint("./checkpoint");
+        // the store goes on compacting away the files the checkpoint links to
+        for(int i = 0; i < 100000; i++)
+            kv_store.put(rng() % 20000, std::string(rng() % 200, 'x'));
+        size_t files = std::distance(std::filesystem::directory_iterator("./checkpoint"), std::filesystem::directory_iterator());
+        check(result == 0 && files > 1, std::format("checkpoint: {}, {} files", result, files));
+        check(kv_store.createCheckpoint("./checkpoint") == -1, "checkpoint into an existing directory fails");
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./checkpoint", options);
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(20000));
+        check(wrong == 0, std::format("opened checkpoint: {} wrong", wrong));
+        // the reopened store takes writes, flushes and compacts on top of the checkpoint
+        for(int i = 0; i < 50000; i++) {
+            uint64_t key = rng() % 20000;
+            std::string value = std::format("{}-{}", key, i);
+            kv_store.put(key, value);
+            expected[key] = value;
+        }
+        wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(20000));
+        check(wrong == 0, std::format("written after open: {} wrong", wrong));
+        kv_store.createCheckpoint("./checkpoint2");
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./checkpoint2", options);
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(20000));
+        check(wrong == 0, std::format("opened again: {} wrong", wrong));
+    }
+    {
+        // a checkpoint that can't link a file is removed, a partial one could be opened as a store.
+        // No compaction replaces the file removed
+        KVStoreOptions no_compaction_options = options;
+        no_compaction_options.level0_file_num_compaction_trigger = 100;
+        no_compaction_options.level0_slowdown_writes_trigger = 101;
+        no_compaction_options.level0_stop_writes_trigger = 102;
+        KVStore<uint64_t, std::string> kv_store("./checkpoint", no_compaction_options);
+        for (const auto& entry : std::filesystem::directory_iterator("./checkpoint")) {
+            if (entry.path().extension() == ".sst") {
+                std::filesystem::remove(entry.path());
+                break;
+            }
+        }
+        int result = kv_store.createCheckpoint("./checkpoint3");
+        check(result == -1 && !std::filesystem::exists("./checkpoint3"), std::format("partial checkpoint: {}", result));
+    }
+    {
+        // a store missing a file its manifest lists fails to open and keeps the manifest as it is
+        std::string sstable_path;
+        for (const auto& entry : std::filesystem::directory_iterator("./checkpoint2")) {
+            if (entry.path().extension() == ".sst")
+                sstable_path = entry.path().string();
+        }
+        std::filesystem::remove(sstable_path);
+        auto manifest_size = std::filesystem::file_size("./checkpoint2/MANIFEST");
+        KVStore<uint64_t, std::string> kv_store("./checkpoint2", options);
+        kv_store.put(0, "0");
+        int result = kv_store.createCheckpoint("./checkpoint3");
+        bool manifest_kept = std::filesystem::file_size("./checkpoint2/MANIFEST") == manifest_size;
+        check(kv_store.get_status() == -1 && result == -1 && manifest_kept && !std::filesystem::exists("./checkpoint3"),
+            std::format("missing sstable: status {}, checkpoint {}, manifest kept: {}", kv_store.get_status(), result, manifest_kept));
+    }
+    std::filesystem::remove_all("./checkpointdb");
+    std::filesystem::remove_all("./checkpoint3");
+    {
+        // a directory in place of the first sstable fails the first flush, its memtable is kept as the
+        // immutable one. A checkpoint after more writes must flush both memtables
+        std::filesystem::create_directories("./checkpointdb/0-0.sst");
+        KVStore<uint64_t, std::string> kv_store("./checkpointdb", options);
+        for(uint64_t i = 0; i < 100; i++)
+            kv_store.put(i, std::format("{}", i));
+        int failed_result = kv_store.createCheckpoint("./checkpoint3");
+        std::filesystem::remove_all("./checkpointdb/0-0.sst");
+        for(uint64_t i = 100; i < 200; i++)
+            kv_store.put(i, std::format("{}", i));
+        int result = kv_store.createCheckpoint("./checkpoint3");
+        check(failed_result == -1 && result == 0, std::format("checkpoint after a failed flush: {}, {}", failed_result, result));
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./checkpoint3", options);
+        int wrong = 0;
+        for(uint64_t i = 0; i < 200; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += val_ptr == nullptr || *val_ptr != std::format("{}", i);
+        }
+        check(wrong == 0, std::format("writes before and after a failed flush in the checkpoint: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./checkpointdb");
+    std::filesystem::remove_all("./checkpoint");
+    std::filesystem::remove_all("./checkpoint2");
+    std::filesystem::remove_all("./checkpoint3");
+    return failed_checks != 0;
+}
@@ -0,0 +1,61 @@
+#include "TestUtil.h"
+#include <random>
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    std::filesystem::remove_all("./deleterangedb");
+    std::map<uint64_t, std::string> expected;
+    std::mt19937_64 rng(0);
+    uint64_t range_deletes = 0;
+    {
+        KVStore<uint64_t, std::string> kv_store("./deleterangedb", options);
+        // puts and range deletes interleave, so ranges cover keys in the same memtable,
+        // in older memtables and in sstables of both levels
+        for(int round = 0; round < 200; round++) {
+            for(int i = 0; i < 500; i++) {
+                uint64_t key = rng() % 50000;
+                std::string value = std::format("{}-{}", key, round);
+                kv_store.put(key, value);
+                expected[key] = value;
+            }
+            uint64_t begin = rng() % 50000, end = begin + rng() % 2000;
+            kv_store.deleteRange(begin, end);
+            expected.erase(expected.lower_bound(begin), expected.lower_bound(end));
+            range_deletes++;
+        }
+
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(50000));
+        check(wrong == 0, std::format("range deletes: {}, keys left: {}, {} wrong", range_deletes, expected.size(), wrong));
+    }
+
+    // a range tombstone spanning the key ranges of several subcompactions and output sstables
+    // deletes its keys in all of them
+    options.max_subcompactions = 4;
+    std::filesystem::remove_all("./deleterangedb");
+    expected.clear();
+    {
+        KVStore<uint64_t, std::string> kv_store("./deleterangedb", options);
+        for(uint64_t key = 0; key < 40000; key++) {
+            kv_store.put(key, std::format("{}", key));
+            expected[key] = std::format("{}", key);
+        }
+        kv_store.deleteRange(5000, 35000);
+        expected.erase(expected.lower_bound(5000), expected.lower_bound(35000));
+        // enough flushes after the tombstone for major compactions to merge it with the keys it covers
+        for(uint64_t key = 40000; key < 45000; key++) {
+            kv_store.put(key, std::string(100, 'a'));
+            expected[key] = std::string(100, 'a');
+        }
+        // flushes the memtable, so the reopened store reads all writes
+        check(kv_store.flush() == 0, "flush before reopen");
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./deleterangedb", options);
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(45000));
+        check(wrong == 0, std::format("range across subcompactions: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./deleterangedb");
+    return failed_checks != 0;
+}
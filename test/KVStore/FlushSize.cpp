@@ -0,0 +1,60 @@
+#include "TestUtil.h"
+#include <algorithm>
+
+// sizes of the sstables of level in db_path
+vector<uint64_t> getSSTableSizes(const string& db_path, uint32_t level)
+{
+    vector<uint64_t> sizes;
+    for (const auto& entry : std::filesystem::directory_iterator(db_path)) {
+        if (entry.path().filename().string().starts_with(std::format("{}-", level)) && entry.path().extension() == ".sst")
+            sizes.push_back(entry.file_size());
+    }
+    return sizes;
+}
+
+int main()
+{
+    // the same number of writes flushes 1MB memtables according to their bytes. No major
+    // compaction runs, every flush stays in level 0
+    KVStoreOptions options = getTestOptions();
+    options.write_buffer_size = 1024 * 1024;
+    options.level0_file_num_compaction_trigger = 100;
+    options.level0_slowdown_writes_trigger = 101;
+    options.level0_stop_writes_trigger = 102;
+    for (size_t value_size: {8, 4096}) {
+        std::filesystem::remove_all("./flushsizedb");
+        {
+            KVStore<uint64_t, std::string> kv_store("./flushsizedb", options);
+            for(uint64_t i = 0; i < 1000; i++)
+                kv_store.put(i, std::string(value_size, 'v'));
+        }
+        // the values alone fill min_flushes memtables, keys and skip list nodes add less than a quarter
+        // to them. The last memtable is never flushed
+        size_t flushes = getSSTableSizes("./flushsizedb", 0).size();
+        size_t min_flushes = value_size * 1000 / options.write_buffer_size;
+        size_t max_flushes = value_size * 1000 * 5 / 4 / options.write_buffer_size;
+        check(flushes >= min_flushes && flushes <= max_flushes,
+            std::format("1000 values of {} bytes: {} flushes, expected {} to {}", value_size, flushes, min_flushes, max_flushes));
+    }
+
+    // compaction output is cut once it reaches target_file_size, the versions of a key and the
+    // index, bloom filter and header written after the cut only add a little.
+    // The sstable holding the largest keys is smaller
+    options = getTestOptions();
+    options.write_buffer_size = 1024 * 1024;
+    options.target_file_size = 256 * 1024;
+    options.max_subcompactions = 1;
+    std::filesystem::remove_all("./flushsizedb");
+    {
+        KVStore<uint64_t, std::string> kv_store("./flushsizedb", options);
+        for(uint64_t i = 0; i < 8000; i++)
+            kv_store.put(i, std::string(1024, 'a' + i % 26));
+    }
+    vector<uint64_t> sizes = getSSTableSizes("./flushsizedb", 1);
+    std::sort(sizes.begin(), sizes.end());
+    bool near_target = sizes.size() > 1 && sizes.back() <= options.target_file_size * 5 / 4 &&
+        std::all_of(sizes.begin() + 1, sizes.end(), [&options](uint64_t size) { return size >= options.target_file_size; });
+    check(near_target, std::format("level 1: {} sstables, {} to {} bytes", sizes.size(), sizes.empty() ? 0 : sizes.front(), sizes.empty() ? 0 : sizes.back()));
+    std::filesystem::remove_all("./flushsizedb");
+    return failed_checks != 0;
+}
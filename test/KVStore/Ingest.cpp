@@ -0,0 +1,140 @@
+#include "TestUtil.h"
+#include "SstFileWriter.h"
+#include <random>
+
+// build an sstable of keys [100, 200) to path, then rewrite its metadata after change alters it.
+// The checksums match the new metadata, only the checks of ingestExternalFile can reject it
+template<typename Change>
+void writeAltered(const std::string& path, Change change)
+{
+    SSTableBuilder<uint64_t, std::string> builder;
+    builder.open(path, 0, 0, 0);
+    for(uint64_t key = 100; key < 200; key++)
+        builder.add(key, std::format("{}-altered", key));
+    builder.finish();
+    auto& sstable = builder.get_sstable();
+    const BlockHandle& last_block = sstable.blocks.back();
+    std::string data(last_block.file_offset + last_block.size + BlockHandle::kTrailerSize, '\0');
+    std::ifstream(path, std::ios::binary).read(data.data(), data.size());
+
+    change(sstable);
+    FileWriter writer;
+    if (writer.open(path) || writer.append(data.data(), data.size()) || sstable.writeToFile(writer) || writer.close())
+        check(false, std::format("rewrite {}", path));
+}
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    std::filesystem::remove_all("./ingestdb");
+    std::map<uint64_t, std::string> expected;
+    std::mt19937_64 rng(0);
+    auto count_wrong = [&expected](KVStore<uint64_t, std::string>& kv_store) {
+        return countWrong(kv_store, expected, uint64_t(0), uint64_t(40000));
+    };
+    {
+        KVStore<uint64_t, std::string> kv_store("./ingestdb", options);
+        // keys no sstable has yet go to level 1
+        SstFileWriter<uint64_t, std::string> writer;
+        writer.open("./ingest.sst");
+        for(uint64_t key = 20000; key < 40000; key += 2) {
+            writer.put(key, std::format("{}-ingested", key));
+            expected[key] = std::format("{}-ingested", key);
+        }
+        writer.finish();
+        int result = kv_store.ingestExternalFile("./ingest.sst");
+        int wrong = count_wrong(kv_store);
+        check(result == 0 && wrong == 0, std::format("ingest into empty range: {}, {} wrong", result, wrong));
+
+        for(int i = 0; i < 100000; i++) {
+            uint64_t key = rng() % 40000;
+            std::string value = std::format("{}-{}", key, i);
+            kv_store.put(key, value);
+            expected[key] = value;
+        }
+        auto snapshot = kv_store.getSnapshot();
+        auto before = expected;
+        // the keys of the file overlap the memtable and the sstables, its values and tombstones win
+        writer.open("./ingest.sst");
+        for(uint64_t key = 10000; key < 30000; key += 3) {
+            if(key % 2) {
+                writer.del(key);
+                expected.erase(key);
+            } else {
+                writer.put(key, std::format("{}-again", key));
+                expected[key] = std::format("{}-again", key);
+            }
+        }
+        writer.finish();
+        result = kv_store.ingestExternalFile("./ingest.sst");
+        wrong = count_wrong(kv_store);
+        check(result == 0 && wrong == 0, std::format("ingest over written keys: {}, {} wrong", result, wrong));
+        wrong = countWrong(kv_store, before, uint64_t(0), uint64_t(40000), snapshot.get());
+        check(wrong == 0, std::format("snapshot before ingest: {} wrong", wrong));
+        snapshot.reset();
+
+        // newer writes win over the file, also after compacting them together
+        for(int i = 0; i < 100000; i++) {
+            uint64_t key = rng() % 40000;
+            std::string value = std::format("{}-{}", key, i);
+            kv_store.put(key, value);
+            expected[key] = value;
+        }
+        wrong = count_wrong(kv_store);
+        check(wrong == 0, std::format("written after ingest: {} wrong", wrong));
+        // spanning all keys, the memtable is flushed before the file is added
+        writer.open("./ingest.sst");
+        writer.put(0, "0-spanning");
+        writer.put(39999, "39999-spanning");
+        writer.finish();
+        expected[0] = "0-spanning";
+        expected[39999] = "39999-spanning";
+        result = kv_store.ingestExternalFile("./ingest.sst");
+        wrong = count_wrong(kv_store);
+        check(result == 0 && wrong == 0, std::format("ingest over the memtable: {}, {} wrong", result, wrong));
+
+        check(SstFileWriter<uint64_t, std::string>().put(1, "1") == -1, "put before open fails");
+        writer.open("./ingest.sst");
+        writer.put(5, "5");
+        check(writer.put(3, "3") == -1, "out of order put fails");
+        // blob indexes point into the blob files of the store that wrote them
+        SSTableBuilder<uint64_t, std::string> builder;
+        builder.open("./ingest.sst", 0, 0, 0);
+        builder.addBlobIndex(7, BlobIndex{0, 0, 100});
+        builder.finish();
+        check(kv_store.ingestExternalFile("./ingest.sst") == -1, "ingest of a blob index fails");
+        check(kv_store.ingestExternalFile("./missing.sst") == -1, "ingest of a missing file fails");
+        // a header understating the keys would place the file in level 1 over the sstables holding them
+        writeAltered("./ingest.sst", [](SSTable<uint64_t, std::string>& sstable) { sstable.header.min_key = 150; });
+        check(kv_store.ingestExternalFile("./ingest.sst") == -1, "ingest with a wrong min key fails");
+        writeAltered("./ingest.sst", [](SSTable<uint64_t, std::string>& sstable) { sstable.header.max_key = 150; });
+        check(kv_store.ingestExternalFile("./ingest.sst") == -1, "ingest with a wrong max key fails");
+        // an index pointing outside the blocks
+        writeAltered("./ingest.sst", [](SSTable<uint64_t, std::string>& sstable) {
+            sstable.blocks.clear();
+            sstable.header.block_count = 0;
+        });
+        check(kv_store.ingestExternalFile("./ingest.sst") == -1, "ingest without blocks fails");
+        writeAltered("./ingest.sst", [](SSTable<uint64_t, std::string>& sstable) {
+            SSTableIndex<uint64_t> index;
+            for (auto iter = sstable.index.begin(); iter.valid(); iter.next()) {
+                const auto& entry = iter.get_entry();
+                index.add(entry.key, entry.offset, entry.key == 199 ? entry.size + 1000 : entry.size);
+            }
+            sstable.index = std::move(index);
+        });
+        check(kv_store.ingestExternalFile("./ingest.sst") == -1, "ingest of an entry past its block fails");
+        wrong = count_wrong(kv_store);
+        check(wrong == 0, std::format("after failed ingests: {} wrong", wrong));
+    }
+    {
+        // the writes the last ingest flushed are all in the reopened store
+        KVStore<uint64_t, std::string> kv_store("./ingestdb", options);
+        int wrong = count_wrong(kv_store);
+        check(wrong == 0, std::format("reopened: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./ingestdb");
+    std::filesystem::remove("./ingest.sst");
+    return failed_checks != 0;
+}
@@ -0,0 +1,86 @@
+#include "TestUtil.h"
+#include <random>
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    // counters, merges interleave with puts and deletes so operands meet values, tombstones
+    // and other operands in memtables, sstables and compaction
+    std::filesystem::remove_all("./mergedb");
+    {
+        KVStore<uint64_t, int64_t> kv_store("./mergedb", options, std::make_shared<AddOperator<int64_t>>());
+        std::map<uint64_t, int64_t> expected;
+        std::mt19937_64 rng(0);
+        for(int i = 0; i < 300000; i++) {
+            uint64_t key = rng() % 5000;
+            int op = rng() % 100;
+            if(op < 80) {
+                kv_store.merge(key, 1);
+                expected[key] += 1;
+            } else if(op < 90) {
+                kv_store.put(key, 1000);
+                expected[key] = 1000;
+            } else if(op < 99) {
+                kv_store.del(key);
+                expected.erase(key);
+            } else {
+                kv_store.deleteRange(key, key + 100);
+                expected.erase(expected.lower_bound(key), expected.lower_bound(key + 100));
+            }
+        }
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(5000));
+        check(wrong == 0, std::format("counters: {}, {} wrong", expected.size(), wrong));
+    }
+
+    std::filesystem::remove_all("./mergedb");
+    {
+        KVStore<uint64_t, std::string> kv_store("./mergedb", options, std::make_shared<AppendOperator>(","));
+        for(int round = 0; round < 10; round++)
+            for(uint64_t key = 0; key < 2000; key++)
+                kv_store.merge(key, std::to_string(round));
+        int wrong = 0;
+        for(uint64_t key = 0; key < 2000; key++) {
+            auto val_ptr = kv_store.get(key);
+            wrong += val_ptr == nullptr || *val_ptr != "0,1,2,3,4,5,6,7,8,9";
+        }
+        check(wrong == 0, std::format("lists: {} wrong", wrong));
+        KVStore<uint64_t, std::string> no_merge_store("./mergedb2", options);
+        check(no_merge_store.merge(0, "x") == -1, "merge without an operator");
+    }
+
+    // operands on a tombstone or a range tombstone don't apply to the value under it, neither in
+    // the memtable and sstables nor once compaction folded them
+    std::filesystem::remove_all("./mergedb");
+    std::map<uint64_t, std::string> expected;
+    {
+        KVStore<uint64_t, std::string> kv_store("./mergedb", options, std::make_shared<AppendOperator>(","));
+        for(uint64_t key = 0; key < 2000; key++)
+            kv_store.put(key, "old");
+        for(uint64_t key = 0; key < 1000; key += 2)
+            kv_store.del(key);
+        kv_store.deleteRange(1000, 2000);
+        for(uint64_t key = 0; key < 2000; key++)
+            kv_store.merge(key, "a");
+        // the first operands are flushed, the next ones stay in the memtable
+        check(kv_store.flush() == 0, "flush the operands");
+        for(uint64_t key = 0; key < 2000; key++) {
+            kv_store.merge(key, "b");
+            expected[key] = key < 1000 && key % 2 ? "old,a,b" : "a,b";
+        }
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(2000));
+        check(wrong == 0, std::format("merge on a tombstone: {} wrong", wrong));
+        // enough flushes for major compactions to fold the operands
+        for(uint64_t key = 10000; key < 15000; key++)
+            kv_store.put(key, std::string(100, 'a'));
+        check(kv_store.flush() == 0, "flush before reopen");
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./mergedb", options, std::make_shared<AppendOperator>(","));
+        int wrong = countWrong(kv_store, expected, uint64_t(0), uint64_t(2000));
+        check(wrong == 0, std::format("merge on a tombstone after compaction: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./mergedb");
+    std::filesystem::remove_all("./mergedb2");
+    return failed_checks != 0;
+}
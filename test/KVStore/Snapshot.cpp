@@ -0,0 +1,86 @@
+#include "TestUtil.h"
+#include <random>
+#include <thread>
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    // snapshots are taken while puts, deletes, range deletes and merges go on, flushes and
+    // compactions happen in between, every live snapshot must still read what it saw
+    std::filesystem::remove_all("./snapshotdb");
+    {
+        KVStore<uint64_t, int64_t> kv_store("./snapshotdb", options, std::make_shared<AddOperator<int64_t>>());
+        std::map<uint64_t, int64_t> expected;
+        vector<std::pair<shared_ptr<const Snapshot>, std::map<uint64_t, int64_t>>> snapshots;
+        std::mt19937_64 rng(0);
+        size_t released = 0;
+        for(int i = 0; i < 300000; i++) {
+            uint64_t key = rng() % 5000;
+            int op = rng() % 100;
+            if(op < 60) {
+                kv_store.put(key, i);
+                expected[key] = i;
+            } else if(op < 80) {
+                kv_store.merge(key, 1);
+                expected[key] += 1;
+            } else if(op < 95) {
+                kv_store.del(key);
+                expected.erase(key);
+            } else if(op < 96) {
+                kv_store.deleteRange(key, key + 100);
+                expected.erase(expected.lower_bound(key), expected.lower_bound(key + 100));
+            }
+            if(i % 20000 == 0) {
+                snapshots.emplace_back(kv_store.getSnapshot(), expected);
+            }
+            // release some snapshots, compaction may then drop the versions only they read
+            if(i % 50000 == 0 && snapshots.size() > 1) {
+                snapshots.erase(snapshots.begin() + rng() % snapshots.size());
+                released++;
+            }
+        }
+        snapshots.emplace_back(nullptr, expected);
+
+        int wrong = 0;
+        for(const auto& [snapshot, snapshot_expected]: snapshots) {
+            wrong += countWrong(kv_store, snapshot_expected, uint64_t(0), uint64_t(5000), snapshot.get());
+        }
+        check(wrong == 0, std::format("snapshots: {} live, {} released, {} wrong", snapshots.size() - 1, released, wrong));
+    }
+
+    // a snapshot released while compactions run, the versions of the snapshots still live are kept
+    std::filesystem::remove_all("./snapshotdb");
+    {
+        KVStore<uint64_t, int64_t> kv_store("./snapshotdb", options);
+        std::map<uint64_t, int64_t> expected[3];
+        shared_ptr<const Snapshot> snapshots[2];
+        for(int64_t round = 0; round < 3; round++) {
+            for(uint64_t key = 0; key < 5000; key++) {
+                kv_store.put(key, round);
+                expected[round][key] = round;
+            }
+            if(round < 2) {
+                snapshots[round] = kv_store.getSnapshot();
+            }
+        }
+        // other keys keep flushing and compacting while the first snapshot is released
+        std::thread writer([&kv_store]() {
+            for(uint64_t key = 10000; key < 60000; key++)
+                kv_store.put(key, key);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        snapshots[0].reset();
+        int wrong = 0;
+        for(int i = 0; i < 5; i++) {
+            wrong += countWrong(kv_store, expected[1], uint64_t(0), uint64_t(5000), snapshots[1].get());
+            wrong += countWrong(kv_store, expected[2], uint64_t(0), uint64_t(5000));
+        }
+        writer.join();
+        wrong += countWrong(kv_store, expected[1], uint64_t(0), uint64_t(5000), snapshots[1].get());
+        wrong += countWrong(kv_store, expected[2], uint64_t(0), uint64_t(5000));
+        check(wrong == 0, std::format("snapshot released while compacting: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./snapshotdb");
+    return failed_checks != 0;
+}
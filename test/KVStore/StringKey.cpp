@@ -0,0 +1,86 @@
+#include "TestUtil.h"
+#include <algorithm>
+
+std::string makeKey(uint64_t i)
+{
+    // keys of different lengths sharing long prefixes
+    return std::format("user:{}:{}", i % 7 == 0 ? "admin" : "member", i * 7919 % 100003) + std::string(i % 5, '#');
+}
+
+int main()
+{
+    KVStoreOptions options;
+    options.write_buffer_size = 256 * 1024;
+    options.target_file_size = 32 * 1024;
+    options.level0_file_num_compaction_trigger = 4;
+
+    std::filesystem::remove_all("./stringdb");
+    {
+        KVStore<std::string, std::string> kv_store("./stringdb", options);
+        for(int round = 0; round < 3; round++)
+            for(uint64_t i = 0; i < 10000; i++)
+                kv_store.put(makeKey(i), std::format("{}-{}", i, round));
+        for(uint64_t i = 0; i < 10000; i += 10)
+            kv_store.del(makeKey(i));
+
+        int wrong = 0;
+        for(uint64_t i = 0; i < 10000; i++) {
+            auto val_ptr = kv_store.get(makeKey(i));
+            if(i % 10 == 0 ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != std::format("{}-2", i))
+                wrong++;
+        }
+        check(wrong == 0, std::format("string keys: {} wrong", wrong));
+        // longer keys sharing a whole key as their prefix, and prefixes of keys
+        wrong = 0;
+        for(uint64_t i = 0; i < 1000; i++) {
+            wrong += kv_store.get(makeKey(i) + "?") != nullptr;
+            wrong += kv_store.get(makeKey(i).substr(0, 5)) != nullptr;
+        }
+        check(wrong == 0, std::format("missing string keys: {} wrong", wrong));
+    }
+
+    // the store waits for its compactions when it is closed. Every sstable must hold its keys in
+    // increasing byte order within [min_key, max_key], and the level 1 ranges must be disjoint
+    int unordered = 0;
+    vector<std::pair<std::string, std::string>> level1_ranges;
+    for (const auto& entry : std::filesystem::directory_iterator("./stringdb")) {
+        if (entry.path().extension() != ".sst")
+            continue;
+        SSTable<std::string, std::string> sstable;
+        if (sstable.readFromFile(entry.path().string())) {
+            unordered++;
+            continue;
+        }
+        std::string last_key;
+        uint64_t count = 0;
+        for (auto iter = sstable.index.begin(); iter.valid(); iter.next(), count++) {
+            const std::string& key = iter.get_entry().key;
+            unordered += count == 0 ? key != sstable.header.min_key : key < last_key;
+            last_key = key;
+        }
+        unordered += last_key != sstable.header.max_key;
+        if (entry.path().filename().string().starts_with("1-"))
+            level1_ranges.emplace_back(sstable.header.min_key, sstable.header.max_key);
+    }
+    std::sort(level1_ranges.begin(), level1_ranges.end());
+    for (size_t i = 1; i < level1_ranges.size(); i++)
+        unordered += !(level1_ranges[i - 1].second < level1_ranges[i].first);
+    check(unordered == 0 && level1_ranges.size() > 1, std::format("string key order: {} level 1 sstables, {} wrong", level1_ranges.size(), unordered));
+
+    // negative keys must be found by the index as well
+    std::filesystem::remove_all("./stringdb");
+    {
+        KVStore<int64_t, std::string> kv_store("./stringdb", options);
+        for(int64_t i = -5000; i < 5000; i++)
+            kv_store.put(i * 3, std::string(50, 'a' + (i + 5000) % 26));
+        int wrong = 0;
+        for(int64_t i = -5000; i < 5000; i++) {
+            auto val_ptr = kv_store.get(i * 3);
+            wrong += val_ptr == nullptr || *val_ptr != std::string(50, 'a' + (i + 5000) % 26);
+            wrong += kv_store.get(i * 3 + 1) != nullptr;
+        }
+        check(wrong == 0, std::format("signed keys: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./stringdb");
+    return failed_checks != 0;
+}
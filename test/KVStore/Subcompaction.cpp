@@ -0,0 +1,57 @@
+#include "TestUtil.h"
+#include <algorithm>
+
+int main()
+{
+    // writes stop at 6 level 0 sstables, so the rounds below can't be flushed without major compactions.
+    // Each of them is split into up to 4 subcompactions
+    KVStoreOptions options = getTestOptions();
+    options.level0_slowdown_writes_trigger = 5;
+    options.level0_stop_writes_trigger = 6;
+    options.max_subcompactions = 4;
+
+    std::filesystem::remove_all("./subcompactiondb");
+    std::map<uint64_t, uint64_t> expected[3];
+    {
+        KVStore<uint64_t, uint64_t> kv_store("./subcompactiondb", options);
+        // the snapshots keep a version of every key from each round
+        shared_ptr<const Snapshot> snapshots[2];
+        for(uint64_t round = 0; round < 3; round++) {
+            for(uint64_t key = 0; key < 20000; key++) {
+                kv_store.put(key, key * 10 + round);
+                expected[round][key] = key * 10 + round;
+            }
+            if(round < 2) {
+                snapshots[round] = kv_store.getSnapshot();
+            }
+        }
+        int wrong = 0;
+        for(uint64_t round = 0; round < 2; round++) {
+            wrong += countWrong(kv_store, expected[round], uint64_t(0), uint64_t(20000), snapshots[round].get());
+        }
+        wrong += countWrong(kv_store, expected[2], uint64_t(0), uint64_t(20000));
+        check(wrong == 0, std::format("versions after subcompactions: {} wrong", wrong));
+    }
+
+    // the store waits for its compactions when it is closed, the level 1 sstables left must split the keys
+    // into disjoint ranges
+    vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (const auto& entry : std::filesystem::directory_iterator("./subcompactiondb")) {
+        string filename = entry.path().filename().string();
+        if (filename.starts_with("1-") && entry.path().extension() == ".sst") {
+            SSTable<uint64_t, uint64_t> sstable;
+            if (sstable.readFromFile(entry.path().string()) == 0) {
+                ranges.emplace_back(sstable.header.min_key, sstable.header.max_key);
+            }
+        }
+    }
+    std::sort(ranges.begin(), ranges.end());
+    int overlapping = 0;
+    for (size_t i = 1; i < ranges.size(); i++) {
+        overlapping += !(ranges[i - 1].second < ranges[i].first);
+    }
+    check(ranges.size() > 1 && overlapping == 0, std::format("level 1: {} sstables, {} overlapping", ranges.size(), overlapping));
+
+    std::filesystem::remove_all("./subcompactiondb");
+    return failed_checks != 0;
+}
@@ -0,0 +1,112 @@
+#include "TestUtil.h"
+#include <thread>
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    std::filesystem::remove_all("./ttldb");
+    {
+        // odd keys expire after 5 seconds, even keys are kept, both end up in memtables and sstables
+        KVStore<uint64_t, std::string> kv_store("./ttldb", options);
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < 20000; i++) {
+            if(i % 2)
+                kv_store.put(i, std::string(20, 'a' + i % 26), 5000);
+            else
+                kv_store.put(i, std::string(20, 'a' + i % 26));
+        }
+        int wrong = 0;
+        for(uint64_t i = 0; i < 20000; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += val_ptr == nullptr || *val_ptr != std::string(20, 'a' + i % 26);
+        }
+        check(wrong == 0, std::format("before expiry: {} wrong", wrong));
+
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(5100));
+        // more writes compact the expired values away
+        for(uint64_t i = 20000; i < 60000; i++)
+            kv_store.put(i, std::string(20, 'a' + i % 26));
+        wrong = 0;
+        for(uint64_t i = 0; i < 20000; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += i % 2 ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != std::string(20, 'a' + i % 26);
+        }
+        check(wrong == 0, std::format("after expiry: {} wrong", wrong));
+    }
+
+    std::filesystem::remove_all("./ttldb");
+    {
+        // values flushed before they expire and compacted after, the older values under them stay hidden
+        KVStore<uint64_t, std::string> kv_store("./ttldb", options);
+        for(uint64_t i = 0; i < 2000; i++)
+            kv_store.put(i, "old");
+        check(kv_store.flush() == 0, "flush the old values");
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < 2000; i++)
+            kv_store.put(i, "new", 1000);
+        check(kv_store.flush() == 0, "flush the new values");
+        int wrong = 0;
+        for(uint64_t i = 0; i < 2000; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += val_ptr == nullptr || *val_ptr != "new";
+        }
+        bool flushed_in_time = std::chrono::steady_clock::now() < start + std::chrono::milliseconds(1000);
+        check(wrong == 0 || !flushed_in_time, std::format("flushed before expiry: {} wrong", wrong));
+
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(1100));
+        // enough flushes for major compactions to merge the expired values with the old ones
+        for(uint64_t i = 10000; i < 15000; i++)
+            kv_store.put(i, std::string(100, 'a'));
+        check(kv_store.flush() == 0, "flush the filler values");
+    }
+    {
+        KVStore<uint64_t, std::string> kv_store("./ttldb", options);
+        int wrong = 0;
+        for(uint64_t i = 0; i < 2000; i++)
+            wrong += kv_store.get(i) != nullptr;
+        check(wrong == 0, std::format("expired between flush and compaction: {} wrong", wrong));
+    }
+
+    std::filesystem::remove_all("./ttldb");
+    {
+        // ttls so large that now + ttl overflows never expire, in the memtable, after a flush and after compactions
+        KVStore<uint64_t, std::string> kv_store("./ttldb", options);
+        const uint64_t ttls[] = {UINT64_MAX, UINT64_MAX - 1000, uint64_t(1) << 63};
+        for(uint64_t i = 0; i < 3; i++)
+            kv_store.put(i, std::format("{}", ttls[i]), ttls[i]);
+        auto count_expired = [&kv_store, &ttls]() {
+            int expired = 0;
+            for(uint64_t i = 0; i < 3; i++) {
+                auto val_ptr = kv_store.get(i);
+                expired += val_ptr == nullptr || *val_ptr != std::format("{}", ttls[i]);
+            }
+            return expired;
+        };
+        int expired = count_expired();
+        check(kv_store.flush() == 0, "flush the large ttl values");
+        expired += count_expired();
+        for(uint64_t i = 10000; i < 30000; i++)
+            kv_store.put(i, std::string(100, 'a'));
+        expired += count_expired();
+        check(expired == 0, std::format("very large ttl: {} expired", expired));
+    }
+
+    std::filesystem::remove_all("./ttldb");
+    {
+        // a store wide ttl, and a merge into an expired counter starts it over
+        options.default_ttl_ms = 500;
+        KVStore<uint64_t, int64_t> kv_store("./ttldb", options, std::make_shared<AddOperator<int64_t>>());
+        kv_store.put(1, 10);
+        kv_store.merge(1, 5);
+        auto before = kv_store.get(1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        auto expired = kv_store.get(1);
+        kv_store.merge(1, 7);
+        auto after = kv_store.get(1);
+        check(before && *before == 15 && !expired && after && *after == 7,
+            std::format("default ttl: {} {} {}", before ? *before : -1, expired ? *expired : -1, after ? *after : -1));
+    }
+    std::filesystem::remove_all("./ttldb");
+    return failed_checks != 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../TestUtil.h"
+#include "KVStore.h"
+#include <map>
+
+// small memtables and sstables, so a few thousand writes flush and compact both levels
+inline KVStoreOptions getTestOptions()
+{
+    KVStoreOptions options;
+    options.write_buffer_size = 64 * 1024;
+    options.target_file_size = 64 * 1024;
+    options.level0_file_num_compaction_trigger = 4;
+    return options;
+}
+
+// number of keys in [begin, end) that kv_store (through snapshot) doesn't read as in expected
+template<typename KType, typename VType>
+int countWrong(KVStore<KType, VType>& kv_store, const std::map<KType, VType>& expected, KType begin, KType end, const Snapshot* snapshot = nullptr)
+{
+    int wrong = 0;
+    for(KType key = begin; key < end; key++) {
+        auto val_ptr = kv_store.get(key, snapshot);
+        auto iter = expected.find(key);
+        wrong += iter == expected.end() ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != iter->second;
+    }
+    return wrong;
+}
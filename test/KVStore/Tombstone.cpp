@@ -0,0 +1,40 @@
+#include "TestUtil.h"
+
+int main()
+{
+    KVStoreOptions options = getTestOptions();
+
+    // values that used to be delete markers are ordinary values
+    std::filesystem::remove_all("./tombstonedb");
+    {
+        KVStore<uint64_t, std::string> kv_store("./tombstonedb", options);
+        for(uint64_t i = 0; i < 20000; i++)
+            kv_store.put(i, i % 2 ? "~DELETED~" : "");
+        // deletes reach the older values in the sstables
+        for(uint64_t i = 0; i < 20000; i += 3)
+            kv_store.del(i);
+        int wrong = 0;
+        for(uint64_t i = 0; i < 20000; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += i % 3 == 0 ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != (i % 2 ? "~DELETED~" : "");
+        }
+        check(wrong == 0, std::format("string values: {} wrong", wrong));
+    }
+
+    std::filesystem::remove_all("./tombstonedb");
+    {
+        KVStore<int64_t, int> kv_store("./tombstonedb", options);
+        for(int64_t i = 0; i < 20000; i++)
+            kv_store.put(i, i % 2 ? -1 : 0);
+        for(int64_t i = 0; i < 20000; i += 3)
+            kv_store.del(i);
+        int wrong = 0;
+        for(int64_t i = 0; i < 20000; i++) {
+            auto val_ptr = kv_store.get(i);
+            wrong += i % 3 == 0 ? val_ptr != nullptr : val_ptr == nullptr || *val_ptr != (i % 2 ? -1 : 0);
+        }
+        check(wrong == 0, std::format("int values: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./tombstonedb");
+    return failed_checks != 0;
+}
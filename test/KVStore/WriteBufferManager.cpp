@@ -0,0 +1,65 @@
+#include "TestUtil.h"
+
+int main()
+{
+    // 4 stores whose memtables may grow to 1MB each, but only 1MB in total
+    KVStoreOptions options;
+    options.write_buffer_size = 1024 * 1024;
+    options.write_buffer_manager = make_shared<WriteBufferManager>(1024 * 1024);
+
+    std::filesystem::remove_all("./writebufferdb");
+    std::filesystem::create_directory("./writebufferdb");
+    vector<unique_ptr<KVStore<uint64_t, std::string>>> kv_stores;
+    for(int i = 0; i < 4; i++)
+    {
+        kv_stores.push_back(make_unique<KVStore<uint64_t, std::string>>(std::format("./writebufferdb/shard{}", i), options));
+    }
+
+    uint64_t max_memory_usage = 0;
+    for(int i = 0; i < 20000; i++)
+    {
+        kv_stores[i % 4]->put(i, std::string(100, 'a' + i % 26));
+        max_memory_usage = std::max(max_memory_usage, options.write_buffer_manager->get_memory_usage());
+    }
+    // the memtable being flushed is still counted while the next one fills up
+    check(max_memory_usage <= 2 * options.write_buffer_manager->get_buffer_size(),
+        std::format("max memory usage: {}, buffer size: {}", max_memory_usage, options.write_buffer_manager->get_buffer_size()));
+
+    int wrong = 0;
+    for(int i = 0; i < 20000; i++)
+    {
+        auto val_ptr = kv_stores[i % 4]->get(i);
+        wrong += val_ptr == nullptr || *val_ptr != std::string(100, 'a' + i % 26);
+    }
+    check(wrong == 0, std::format("values of 4 stores: {} wrong", wrong));
+
+    kv_stores.clear();
+    check(options.write_buffer_manager->get_memory_usage() == 0,
+        std::format("memory usage after close: {}", options.write_buffer_manager->get_memory_usage()));
+
+    // the memtables only flush through the manager, which must keep working once one of its stores is gone
+    options.write_buffer_size = 64 * 1024 * 1024;
+    for(int i = 0; i < 2; i++)
+    {
+        kv_stores.push_back(make_unique<KVStore<uint64_t, std::string>>(std::format("./writebufferdb/shard{}", i), options));
+    }
+    for(int i = 0; i < 4000; i++)
+    {
+        kv_stores[i % 2]->put(i, std::string(100, 'a' + i % 26));
+    }
+    kv_stores.erase(kv_stores.begin());
+    max_memory_usage = 0;
+    for(int i = 0; i < 40000; i++)
+    {
+        kv_stores[0]->put(i, std::string(100, 'a' + i % 26));
+        max_memory_usage = std::max(max_memory_usage, options.write_buffer_manager->get_memory_usage());
+    }
+    check(max_memory_usage <= 2 * options.write_buffer_manager->get_buffer_size(),
+        std::format("max memory usage after closing a store: {}, buffer size: {}", max_memory_usage, options.write_buffer_manager->get_buffer_size()));
+
+    kv_stores.clear();
+    check(options.write_buffer_manager->get_memory_usage() == 0,
+        std::format("memory usage after closing all stores: {}", options.write_buffer_manager->get_memory_usage()));
+    std::filesystem::remove_all("./writebufferdb");
+    return failed_checks != 0;
+}
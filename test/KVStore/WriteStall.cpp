@@ -0,0 +1,86 @@
+#include "TestUtil.h"
+
+// flush count batches of 100 values to level 0 sstables, no major compaction runs. Returns the path of one of them
+std::string writeLevel0(const std::string& db_path, int count)
+{
+    KVStoreOptions options = getTestOptions();
+    options.level0_file_num_compaction_trigger = 100;
+    options.level0_slowdown_writes_trigger = 101;
+    options.level0_stop_writes_trigger = 102;
+    std::filesystem::remove_all(db_path);
+    {
+        KVStore<uint64_t, std::string> kv_store(db_path, options);
+        for(int batch = 0; batch < count; batch++) {
+            for(uint64_t i = 0; i < 100; i++)
+                kv_store.put(batch * 100 + i, std::string(100, 'a' + batch));
+            check(kv_store.flush() == 0, std::format("flush batch {}", batch));
+        }
+    }
+    std::string sstable_path;
+    for (const auto& entry : std::filesystem::directory_iterator(db_path)) {
+        if (entry.path().extension() == ".sst")
+            sstable_path = entry.path().string();
+    }
+    return sstable_path;
+}
+
+// change a byte of the first data block of path, the major compaction reading it fails until it is changed back
+void flipByte(const std::string& path)
+{
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekg(10);
+    char byte = file.get();
+    file.seekp(10);
+    file.put(byte ^ 1);
+}
+
+int main()
+{
+    // level 0 has to be compacted from 2 sstables on, writes are delayed from 4 and stopped from 6.
+    // A corrupted sstable keeps major compaction from catching up, so the stall stays until it is repaired
+    KVStoreOptions options = getTestOptions();
+    options.level0_file_num_compaction_trigger = 2;
+    options.level0_slowdown_writes_trigger = 4;
+    options.level0_stop_writes_trigger = 6;
+    options.delayed_write_rate = 1024 * 1024;
+
+    std::string corrupted_path = writeLevel0("./writestalldb", 4);
+    flipByte(corrupted_path);
+    {
+        KVStore<uint64_t, std::string> kv_store("./writestalldb", options);
+        check(kv_store.get_write_stall_condition() == WriteStallCondition::DELAYED, "4 level 0 sstables delay writes");
+        // 100KB at 1MB/s, the first writes may go through on the credit of an idle writer
+        auto start = std::chrono::steady_clock::now();
+        int result = 0;
+        for(uint64_t i = 0; i < 100; i++)
+            result |= kv_store.put(10000 + i, std::string(1000, 'x'));
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        check(result == 0 && elapsed >= 80, std::format("delayed writes: {}, {} ms", result, elapsed));
+    }
+
+    corrupted_path = writeLevel0("./writestalldb", 6);
+    flipByte(corrupted_path);
+    {
+        KVStore<uint64_t, std::string> kv_store("./writestalldb", options);
+        check(kv_store.get_write_stall_condition() == WriteStallCondition::STOPPED, "6 level 0 sstables stop writes");
+        // the write waits for the major compaction, which fails
+        int result = kv_store.put(10000, "x");
+        check(result == -1 && kv_store.get_write_stall_condition() == WriteStallCondition::STOPPED,
+            std::format("stopped write while compaction fails: {}", result));
+
+        // the next write retries the compaction, which catches up now
+        flipByte(corrupted_path);
+        result = kv_store.put(10000, "y");
+        auto val_ptr = kv_store.get(10000);
+        check(result == 0 && kv_store.get_write_stall_condition() == WriteStallCondition::NORMAL && val_ptr != nullptr && *val_ptr == "y",
+            std::format("write after compaction caught up: {}", result));
+        int wrong = 0;
+        for(uint64_t i = 0; i < 600; i++) {
+            val_ptr = kv_store.get(i);
+            wrong += val_ptr == nullptr || *val_ptr != std::string(100, 'a' + i / 100);
+        }
+        check(wrong == 0, std::format("compacted level 0: {} wrong", wrong));
+    }
+    std::filesystem::remove_all("./writestalldb");
+    return failed_checks != 0;
+}
@@ -0,0 +1,60 @@
+#include "RateLimiter.h"
+#include "../TestUtil.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    // 1MB/s refilled every 100ms, the first refill is available at once. 512KB then need 4 more refills
+    RateLimiter rate_limiter(1024 * 1024);
+    uint64_t refill_bytes = 1024 * 1024 / 10;
+    auto start = std::chrono::steady_clock::now();
+    rate_limiter.request(512 * 1024, IOPriority::LOW);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double min_seconds = double(512 * 1024 - refill_bytes) / (1024 * 1024);
+    check(seconds >= min_seconds * 0.9 && seconds < min_seconds * 2 && rate_limiter.getTotalBytesThrough(IOPriority::LOW) == 512 * 1024,
+        std::format("512KB at 1MB/s: {} s, at least {} s", seconds, min_seconds));
+
+    // a flush thread and two compaction threads share the rate for 1 second
+    RateLimiter shared_rate_limiter(1024 * 1024);
+    start = std::chrono::steady_clock::now();
+    auto writer = [&](IOPriority priority, uint64_t bytes_per_write) {
+        while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+            shared_rate_limiter.request(bytes_per_write, priority);
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.emplace_back(writer, IOPriority::HIGH, 4096);
+    threads.emplace_back(writer, IOPriority::LOW, 4096);
+    threads.emplace_back(writer, IOPriority::LOW, 256 * 1024);
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t high_bytes = shared_rate_limiter.getTotalBytesThrough(IOPriority::HIGH);
+    uint64_t low_bytes = shared_rate_limiter.getTotalBytesThrough(IOPriority::LOW);
+    // each refill goes through at most once, the last requests may be granted in pieces
+    double max_bytes = (seconds * 10 + 1) * refill_bytes + 256 * 1024;
+    check(high_bytes + low_bytes <= max_bytes, std::format("high: {} bytes, low: {} bytes in {} s, at most {:.0f} bytes",
+        high_bytes, low_bytes, seconds, max_bytes));
+
+    // a LOW request waits for the next refill, a HIGH request queued after it takes that refill first
+    RateLimiter priority_rate_limiter(1024 * 1024);
+    priority_rate_limiter.request(refill_bytes, IOPriority::HIGH);
+    std::atomic<int> granted{0};
+    int low_order = 0, high_order = 0;
+    std::thread low([&]() {
+        priority_rate_limiter.request(refill_bytes, IOPriority::LOW);
+        low_order = ++granted;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread high([&]() {
+        priority_rate_limiter.request(refill_bytes, IOPriority::HIGH);
+        high_order = ++granted;
+    });
+    low.join();
+    high.join();
+    check(high_order == 1 && low_order == 2, std::format("HIGH granted {}, LOW granted {}", high_order, low_order));
+    return failed_checks != 0;
+}
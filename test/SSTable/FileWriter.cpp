@@ -0,0 +1,57 @@
+#include "FileWriter.h"
+#include "../TestUtil.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+// write size bytes to path in chunks of varying size and read them back, the buffer holds two aligned blocks
+void testWrite(bool use_direct_io, size_t size)
+{
+    std::string expected(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        expected[i] = static_cast<char>(i * 131 + i / 7);
+    }
+    FileWriterOptions options;
+    options.buffer_size = 2 * FileWriter::kAlignment;
+    options.use_direct_io = use_direct_io;
+    FileWriter writer(options);
+    int result = writer.open("./filewriter.data");
+    // chunks smaller than, equal to and larger than the buffer
+    size_t chunk_sizes[] = {1, 100, FileWriter::kAlignment, 3 * FileWriter::kAlignment + 17, 5000};
+    for (size_t pos = 0, chunk = 0; pos < size && !result; chunk++) {
+        size_t chunk_size = std::min(chunk_sizes[chunk % std::size(chunk_sizes)], size - pos);
+        result = writer.append(expected.data() + pos, chunk_size);
+        pos += chunk_size;
+    }
+    uint64_t appended = writer.get_file_size();
+    bool direct_io = writer.is_direct_io();
+    result = result || writer.close();
+
+    std::ifstream file("./filewriter.data", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    check(result == 0 && appended == size && std::filesystem::file_size("./filewriter.data") == size && content == expected,
+        std::format("{} bytes, {}: result {}, file size {}", size, direct_io ? "direct io" : "buffered io", result,
+            std::filesystem::file_size("./filewriter.data")));
+}
+
+int main()
+{
+    // whole blocks, a tail shorter than a block, a single partial block and an empty file
+    for (bool use_direct_io: {false, true}) {
+        for (size_t size: {size_t(10 * FileWriter::kAlignment), size_t(10 * FileWriter::kAlignment + 1234), size_t(777), size_t(0)}) {
+            testWrite(use_direct_io, size);
+        }
+    }
+    // fixed size objects are appended as their bytes
+    FileWriter writer;
+    uint64_t value = 0x0123456789abcdef;
+    int result = writer.open("./filewriter.data") || writer.append(value) || writer.close();
+    std::ifstream file("./filewriter.data", std::ios::binary);
+    uint64_t read_value = 0;
+    file.read(reinterpret_cast<char*>(&read_value), sizeof(read_value));
+    check(result == 0 && read_value == value && std::filesystem::file_size("./filewriter.data") == sizeof(value), "append an object");
+    check(FileWriter::syncDirectory(".") == 0, "sync a directory");
+    check(FileWriter::syncDirectory("./filewriter.data") == -1, "sync a file as a directory fails");
+    std::filesystem::remove("./filewriter.data");
+    return failed_checks != 0;
+}
@@ -0,0 +1,66 @@
+#include "SSTableIndex.h"
+#include "../TestUtil.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <chrono>
+
+// lookups through binary search, the learned model and the Eytzinger layout must all find the first key not less
+// than the one looked up: random keys of the index, keys between and missing from them, and both ends of the range
+void testKeys(const std::string& name, const std::vector<uint64_t>& keys, std::mt19937_64& rng)
+{
+    SSTableIndex<uint64_t> indexes[3];
+    for(auto& index: indexes) {
+        for(size_t i = 0; i < keys.size(); i++)
+            index.add(keys[i], i * 100, 100);
+    }
+    indexes[1].buildLearnedIndex(4);
+    indexes[2].buildEytzingerLayout();
+
+    std::vector<uint64_t> lookup_keys{0, keys.front(), keys.back(), keys.back() + 1, UINT64_MAX};
+    if (keys.front() > 0)
+        lookup_keys.push_back(keys.front() - 1);
+    for(int i = 0; i < 100000; i++) {
+        uint64_t key = keys[rng() % keys.size()];
+        lookup_keys.push_back(i % 3 == 0 ? key : i % 3 == 1 ? key + 1 : keys.front() + rng() % (keys.back() - keys.front() + 2));
+    }
+
+    std::string result = name + ":";
+    for(int j = 0; j < 3; j++) {
+        std::vector<size_t> positions;
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t key: lookup_keys) {
+            auto iter = indexes[j].lowerBound(key);
+            positions.push_back(iter.valid() ? iter.get_position() : keys.size());
+        }
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        int wrong = 0;
+        for(size_t i = 0; i < lookup_keys.size(); i++)
+            wrong += positions[i] != size_t(std::lower_bound(keys.begin(), keys.end(), lookup_keys[i]) - keys.begin());
+        result += std::format(" {} {}us,", j == 0 ? "binary search" : j == 1 ? "learned" : "eytzinger", micros);
+        check(wrong == 0, std::format("{} {}: {} wrong", name, j == 0 ? "binary search" : j == 1 ? "learned" : "eytzinger", wrong));
+    }
+    std::cout << std::format("{} segments: {}\n", result, indexes[1].get_model() ? indexes[1].get_model()->get_segment_count() : 0);
+}
+
+int main()
+{
+    std::mt19937_64 rng(0);
+    std::vector<uint64_t> linear, near_linear, random;
+    for(uint64_t i = 0; i < 100000; i++) {
+        linear.push_back(1000 + i * 10);
+        near_linear.push_back(1700000000000 + i * 1000 + rng() % 900);
+    }
+    std::set<uint64_t> random_set;
+    while(random_set.size() < 100000)
+        random_set.insert(rng() >> 1);
+    random.assign(random_set.begin(), random_set.end());
+
+    testKeys("linear", linear, rng);
+    testKeys("near linear", near_linear, rng);
+    testKeys("random", random, rng);
+    // indexes of a single restart point or a few of them
+    testKeys("single key", {42}, rng);
+    testKeys("few keys", {0, 5, 6, 100, 1000, 1001, 1002, 5000, 70000}, rng);
+    return failed_checks != 0;
+}
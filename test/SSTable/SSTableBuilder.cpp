@@ -0,0 +1,124 @@
+#include "SSTableBuilder.h"
+#include "SSTableReader.h"
+#include "../TestUtil.h"
+#include <filesystem>
+#include <fstream>
+
+// small json-like values, they compress poorly without a dictionary
+std::string getValue(uint64_t i)
+{
+    return std::format(R"({{"id": {}, "name": "user{}", "age": {}, "city": "{}"}})", i, i * 7919 % 1000, i % 80, std::string(i % 10 + 1, 'a' + i % 26));
+}
+
+// build an sstable of 1000 values in a single pass and read it back, returns its file size
+uint64_t testBuild(CompressionType compression, uint64_t max_dict_bytes = 0)
+{
+    SSTableBuilderOptions options;
+    options.compression = compression;
+    options.max_dict_bytes = max_dict_bytes;
+    options.max_train_bytes = 16 * 1024;
+    SSTableBuilder<uint64_t, std::string> builder(options);
+    int result = builder.open("./test.sst", 0, 0, 1);
+    for(uint64_t i = 0; i < 1000 && !result; i++) {
+        result = builder.add(i * 2, getValue(i));
+    }
+    result = result || builder.finish();
+    std::string name = std::format("compression {}, dictionary {}", static_cast<int>(compression), max_dict_bytes);
+    check(result == 0, std::format("{}: build", name));
+    if (result) {
+        return 0;
+    }
+
+    auto& sstable = builder.get_sstable();
+    std::cout << std::format("{}: kv_count: {}, data_size: {}, block_count: {}, dict_size: {}, index_size: {}, file_size: {}\n",
+        name, sstable.header.kv_count, sstable.header.data_size, sstable.header.block_count, sstable.header.dict_size,
+        sstable.getIndexSpace(), sstable.file_size);
+    check(sstable.header.kv_count == 1000 && sstable.header.min_key == 0 && sstable.header.max_key == 1998 &&
+        sstable.file_size == std::filesystem::file_size("./test.sst"), std::format("{}: header", name));
+    // a dictionary is only trained for zstd blocks
+    bool with_dict = max_dict_bytes > 0 && compression == CompressionType::ZSTD && Compression::isSupported(compression);
+    check((sstable.header.dict_size > 0) == with_dict, std::format("{}: dictionary of {} bytes", name, sstable.header.dict_size));
+
+    // read through the metadata read back from the file
+    SSTable<uint64_t, std::string> opened;
+    check(opened.readFromFile("./test.sst") == 0 && opened.header.max_key == sstable.header.max_key &&
+        opened.index.get_data() == sstable.index.get_data() && opened.header.dict_size == sstable.header.dict_size,
+        std::format("{}: metadata read back", name));
+    SSTableReader<uint64_t, std::string> reader(opened, "./test.sst");
+    int wrong = 0;
+    uint64_t count = 0;
+    for(auto iter = opened.index.begin(); iter.valid(); iter.next(), count++) {
+        uint64_t i = iter.get_position();
+        EntryType type;
+        std::string value;
+        if (reader.read(iter.get_entry(), type, value) || type != EntryType::VALUE || iter.get_entry().key != i * 2 || value != getValue(i))
+            wrong++;
+    }
+    check(wrong == 0 && count == 1000, std::format("{}: {} values read, {} wrong", name, count, wrong));
+    // every key, and the keys between them
+    wrong = 0;
+    for(uint64_t key = 0; key <= 1998; key++) {
+        auto iter = opened.index.lowerBound(key);
+        if (!iter.valid() || iter.get_entry().key != (key + 1) / 2 * 2 || iter.get_position() != (key + 1) / 2)
+            wrong++;
+    }
+    check(wrong == 0 && !opened.index.lowerBound(1999).valid(), std::format("{}: {} wrong lower bounds", name, wrong));
+    return sstable.file_size;
+}
+
+// change the byte at offset of path, from its end if offset is negative
+void corruptByte(const std::string& path, int64_t offset)
+{
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekg(offset, offset < 0 ? std::ios::end : std::ios::beg);
+    char byte = file.get();
+    file.seekp(offset, offset < 0 ? std::ios::end : std::ios::beg);
+    file.put(byte ^ 1);
+}
+
+void testCorruption()
+{
+    SSTableBuilder<uint64_t, std::string> builder;
+    int result = builder.open("./test.sst", 0, 0, 1);
+    for(uint64_t i = 0; i < 100 && !result; i++) {
+        result = builder.add(i, getValue(i));
+    }
+    result = result || builder.finish();
+    check(result == 0, "build sstable to corrupt");
+
+    // a byte of the first block, reading it must fail the checksum
+    corruptByte("./test.sst", 10);
+    auto& sstable = builder.get_sstable();
+    EntryType type;
+    std::string value;
+    SSTableReader<uint64_t, std::string> reader(sstable, "./test.sst");
+    SSTableReader<uint64_t, std::string> unverified_reader(sstable, "./test.sst", false);
+    check(reader.read(sstable.index.begin().get_entry(), type, value) == -1, "corrupted block fails verification");
+    check(unverified_reader.read(sstable.index.begin().get_entry(), type, value) == 0, "corrupted block read without verification");
+    // the next block is still read
+    auto iter = sstable.index.begin();
+    while (iter.valid() && iter.get_entry().key < 99) {
+        iter.next();
+    }
+    check(iter.valid() && reader.read(iter.get_entry(), type, value) == 0 && value == getValue(99), "other block read");
+
+    // a byte of the header, opening the sstable must fail
+    corruptByte("./test.sst", -8);
+    SSTable<uint64_t, std::string> opened;
+    check(opened.readFromFile("./test.sst") != 0, "corrupted header fails to open");
+}
+
+int main()
+{
+    // codecs that are not compiled in fall back to uncompressed blocks, the others must save space
+    uint64_t uncompressed_size = testBuild(CompressionType::NONE);
+    for (auto compression: {CompressionType::LZ4, CompressionType::ZSTD}) {
+        uint64_t file_size = testBuild(compression);
+        bool compressed = Compression::isSupported(compression) ? file_size < uncompressed_size : file_size == uncompressed_size;
+        check(compressed, std::format("compression {}: {} bytes, uncompressed {} bytes", static_cast<int>(compression), file_size, uncompressed_size));
+    }
+    testBuild(CompressionType::ZSTD, 4096);
+    testCorruption();
+    std::filesystem::remove("./test.sst");
+    return failed_checks != 0;
+}
@@ -0,0 +1,117 @@
+#include "SerializeWrapper.h"
+#include "../TestUtil.h"
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct Point {
+    double x;
+    double y;
+
+    bool operator==(const Point&) const = default;
+};
+
+// a user type that is not trivially copyable
+struct Tags {
+    std::vector<std::string> tags;
+
+    bool operator==(const Tags&) const = default;
+};
+
+template<>
+class SerializeWrapper<Tags>: public SerializeWrapperBase<Tags, SerializeWrapper<Tags>> {
+public:
+    static constexpr bool kFixedSize = false;
+
+    static size_t serialize_to(const Tags &obj, std::span<char> dst) {
+        size_t size = 0;
+        for (const auto& tag: obj.tags) {
+            memcpy(dst.data() + size, tag.data(), tag.size());
+            size += tag.size();
+            dst[size++] = ',';
+        }
+        return size;
+    }
+
+    static Tags deserialize_from(std::string_view data) {
+        Tags obj;
+        size_t begin = 0;
+        for (size_t end = data.find(','); end != std::string_view::npos; begin = end + 1, end = data.find(',', begin)) {
+            obj.tags.emplace_back(data.substr(begin, end - begin));
+        }
+        return obj;
+    }
+
+    static uint64_t serialize_size(const Tags &obj) {
+        uint64_t size = 0;
+        for (const auto& tag: obj.tags) {
+            size += tag.size() + 1;
+        }
+        return size;
+    }
+};
+
+// value must round trip through serialize and serialize_to in exactly size bytes, 0 if any size is fine.
+// The bytes without their last one, or with one more, are not a value for varints and fixed size types
+template<typename T>
+void testRoundTrip(const std::string& name, const T& value, size_t size = 0)
+{
+    std::string data = SerializeWrapper<T>::serialize(value);
+    // serialize_to writes nothing past serialize_size
+    std::string buffer(SerializeWrapper<T>::serialize_size(value) + 1, '\x5a');
+    size_t written = SerializeWrapper<T>::serialize_to(value, std::span<char>(buffer.data(), buffer.size() - 1));
+    T copy{};
+    bool ok = SerializeWrapper<T>::deserialize(data) == value && SerializeWrapper<T>::try_deserialize_from(data, copy) && copy == value &&
+        data.size() == SerializeWrapper<T>::serialize_size(value) && written == data.size() &&
+        buffer.substr(0, written) == data && buffer.back() == '\x5a' && (size == 0 || data.size() == size);
+    check(ok, std::format("{}: {} bytes, fixed size: {}", name, data.size(), SerializeWrapper<T>::kFixedSize));
+
+    if constexpr (kVarintSerialized<T> || SerializeWrapper<T>::kFixedSize) {
+        bool truncated = !data.empty() && SerializeWrapper<T>::try_deserialize_from(std::string_view(data).substr(0, data.size() - 1), copy);
+        bool extended = SerializeWrapper<T>::try_deserialize_from(data + '\x01', copy);
+        check(!truncated && !extended, std::format("{}: truncated or extended bytes rejected", name));
+    }
+}
+
+int main()
+{
+    static_assert(SerializeWrapper<double>::kSize == sizeof(double));
+    static_assert(kVarintSerialized<int32_t> && kVarintSerialized<uint64_t> && !kVarintSerialized<bool>);
+    static_assert(SerializeWrapper<Point>::kFixedSize && SerializeWrapper<Point>::kSize == sizeof(Point));
+
+    // zigzag keeps small negative values as short as small positive ones
+    testRoundTrip("int 0", 0, 1);
+    testRoundTrip("int -1", -1, 1);
+    testRoundTrip("int 63", 63, 1);
+    testRoundTrip("int -64", -64, 1);
+    testRoundTrip("int 64", 64, 2);
+    testRoundTrip("int -65", -65, 2);
+    testRoundTrip("int min", INT32_MIN, 5);
+    testRoundTrip("int max", INT32_MAX, 5);
+    testRoundTrip("int8 min", std::numeric_limits<int8_t>::min(), 2);
+    testRoundTrip("int16 max", std::numeric_limits<int16_t>::max(), 3);
+    testRoundTrip("int64 -300", int64_t(-300), 2);
+    testRoundTrip("int64 min", INT64_MIN, 10);
+    testRoundTrip("int64 max", INT64_MAX, 10);
+    testRoundTrip("uint8 max", std::numeric_limits<uint8_t>::max(), 2);
+    testRoundTrip("uint64 127", uint64_t(127), 1);
+    testRoundTrip("uint64 128", uint64_t(128), 2);
+    testRoundTrip("uint64 2^63", uint64_t(1) << 63, 10);
+    testRoundTrip("uint64 max", UINT64_MAX, 10);
+    testRoundTrip("bool", true, 1);
+    testRoundTrip("double", -3.25, sizeof(double));
+    testRoundTrip("float min", std::numeric_limits<float>::lowest(), sizeof(float));
+    testRoundTrip("Point", Point{1.5, -2.5}, sizeof(Point));
+    testRoundTrip("string", std::string("value"), 5);
+    testRoundTrip("empty string", std::string());
+    testRoundTrip("Tags", Tags{{"red", "green", "blue"}});
+
+    // a varint of a value out of the range of the type, or with a needless continuation byte
+    int8_t int8_value;
+    check(!SerializeWrapper<int8_t>::try_deserialize_from(SerializeWrapper<int64_t>::serialize(1000), int8_value), "int8 out of range rejected");
+    uint32_t uint32_value;
+    check(!SerializeWrapper<uint32_t>::try_deserialize_from(std::string("\x81\x00", 2), uint32_value), "overlong varint rejected");
+    check(!SerializeWrapper<uint32_t>::try_deserialize_from("", uint32_value), "empty varint rejected");
+    return failed_checks != 0;
+}
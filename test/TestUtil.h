@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <format>
+
+// checks that failed, the test returns nonzero if there are any
+inline int failed_checks = 0;
+
+// print what was checked, ok or not
+inline void check(bool ok, const std::string& what)
+{
+    std::cout << std::format("{}: {}\n", what, ok ? "ok" : "FAILED");
+    failed_checks += !ok;
+}